@@ -1,19 +1,36 @@
+#pragma once
+
 #include <SDL.h>
-#include <cstdint>
-#include <string>
+#include <vector>
+
+#include "mixer.hpp"
+
+namespace space_invaders
+{
 
-class Wav
+// The one SDL audio device of a cabinet. The cabinet's samples are mixed on
+// the emulation side, by an Audio_stream, and queued here; the device's
+// callback drains them on SDL's audio thread, with silence if it runs dry.
+class Audio_device
 {
 	public:
-	explicit Wav(const std::string &s);
-	~Wav();
-	
-	bool play();
-	void loop();
-	
+	explicit Audio_device(int rate);
+	~Audio_device();
+	Audio_device(const Audio_device &) = delete;
+	Audio_device &operator=(const Audio_device &) = delete;
+
+	bool ready() const;
+	// queues samples after the ones still waiting; what doesn't fit in the
+	// queue (turbo mode runs ahead of the sound card) is dropped
+	void queue(const int16_t *samples, size_t n);
+
 	private:
-	SDL_AudioSpec spec_;
-	SDL_AudioDeviceID dev_;
-	uint8_t *buf_;
-	uint32_t len_;
-};
\ No newline at end of file
+	SDL_AudioDeviceID dev_ {0};
+	std::vector<int16_t> ring_; // about six frames of samples
+	size_t head_ {0}; // the next sample to play
+	size_t size_ {0};
+
+	static void fill(void *device, Uint8 *stream, int len);
+};
+
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace i8080
+{
+
+// Memory bus policies for Cpu. A bus provides read, write and fetch, where
+// fetch returns a pointer to the (up to) three bytes of the instruction at
+// adr, using buf when they can't be read in place.
+
+// plain 64k of ram with no hooks: the compile-time fast path
+class Flat_bus
+{
+	public:
+	Flat_bus(std::array<uint8_t, 0x10000> &mem);
+
+	uint8_t read(uint16_t adr) const;
+	void write(uint16_t adr, uint8_t val);
+	const uint8_t *fetch(uint16_t adr, uint8_t *buf) const;
+
+	private:
+	std::array<uint8_t, 0x10000> &mem_;
+};
+
+// 256 pages of 256 bytes, each mapped straight onto host memory (possibly
+// read-only) or handing its writes to a handler; unmapped pages read as 0
+// and drop writes. Pages without a handler cost a table lookup, so hooks
+// like dirty tracking only slow down the pages they are installed on.
+//
+// Read handlers are opt-in: a call that may happen on every read keeps the
+// compiler from holding the cpu registers in host registers across memory
+// accesses, which costs about a third of the emulation speed.
+template <bool Read_hooks>
+class Basic_paged_bus
+{
+	public:
+	using Reader = uint8_t (*)(void *ctx, uint16_t adr);
+	using Writer = void (*)(void *ctx, uint16_t adr, uint8_t val);
+
+	static constexpr int page_size {0x100};
+	static constexpr int page_count {0x10000 / page_size};
+
+	Basic_paged_bus();
+
+	void map(int first, int count, uint8_t *mem, bool writable = true);
+	void map(int first, int count, const uint8_t *mem);
+	void hook_read(int page, Reader r, void *ctx);
+	void hook_write(int page, Writer w, void *ctx);
+
+	uint8_t read(uint16_t adr) const;
+	void write(uint16_t adr, uint8_t val);
+	const uint8_t *fetch(uint16_t adr, uint8_t *buf) const;
+
+	private:
+	struct Hooks
+	{
+		Reader on_read;
+		Writer on_write;
+		void *read_ctx;
+		void *write_ctx;
+	};
+
+	// direct access to each page, or nullptr to go through its hooks; kept
+	// apart from the hooks so the hot tables stay small
+	std::array<const uint8_t *, page_count> read_;
+	std::array<uint8_t *, page_count> write_;
+	std::array<Hooks, page_count> hooks_;
+
+	static constexpr std::array<uint8_t, page_size> open_bus_page {};
+
+	static uint8_t open_bus(void *ctx, uint16_t adr);
+	static void ignore(void *ctx, uint16_t adr, uint8_t val);
+};
+
+using Paged_bus = Basic_paged_bus<false>;
+using Read_hook_bus = Basic_paged_bus<true>;
+
+// the accessors sit on the instruction path, so everything is defined here
+// to inline into the dispatch loops
+
+inline Flat_bus::Flat_bus(std::array<uint8_t, 0x10000> &mem)
+	: mem_(mem)
+{}
+
+inline uint8_t Flat_bus::read(uint16_t adr) const
+{
+	return mem_[adr];
+}
+
+inline void Flat_bus::write(uint16_t adr, uint8_t val)
+{
+	mem_[adr] = val;
+}
+
+inline const uint8_t *Flat_bus::fetch(uint16_t adr, uint8_t *buf) const
+{
+	if (adr <= 0xFFFD)
+		return &mem_[adr];
+	for (int i {0}; i < 3; ++i)
+		buf[i] = mem_[static_cast<uint16_t>(adr + i)];
+	return buf;
+}
+
+template <bool Read_hooks>
+Basic_paged_bus<Read_hooks>::Basic_paged_bus()
+{
+	write_.fill(nullptr);
+	hooks_.fill({open_bus, ignore, nullptr, nullptr});
+	if (Read_hooks)
+		read_.fill(nullptr);
+	else
+		read_.fill(open_bus_page.data());
+}
+
+template <bool Read_hooks>
+uint8_t Basic_paged_bus<Read_hooks>::open_bus(void *, uint16_t)
+{
+	return 0;
+}
+
+template <bool Read_hooks>
+void Basic_paged_bus<Read_hooks>::ignore(void *, uint16_t, uint8_t)
+{
+}
+
+// maps pages first to first + count - 1 onto mem, dropping any hooks;
+// writes to read-only pages are ignored
+template <bool Read_hooks>
+void Basic_paged_bus<Read_hooks>::map(int first, int count, uint8_t *mem, bool writable)
+{
+	map(first, count, static_cast<const uint8_t *>(mem));
+	if (writable)
+		for (int i {0}; i < count; ++i)
+			write_[first + i] = mem + i * page_size;
+}
+
+template <bool Read_hooks>
+void Basic_paged_bus<Read_hooks>::map(int first, int count, const uint8_t *mem)
+{
+	for (int i {0}; i < count; ++i)
+	{
+		int p {first + i};
+		read_[p] = mem + i * page_size;
+		write_[p] = nullptr;
+		hooks_[p] = {open_bus, ignore, nullptr, nullptr};
+	}
+}
+
+// routes the reads of a page through r instead
+template <bool Read_hooks>
+void Basic_paged_bus<Read_hooks>::hook_read(int page, Reader r, void *ctx)
+{
+	static_assert(Read_hooks, "read hooks need a Read_hook_bus");
+	read_[page] = nullptr;
+	hooks_[page].on_read = r;
+	hooks_[page].read_ctx = ctx;
+}
+
+// routes the writes to a page through w instead
+template <bool Read_hooks>
+void Basic_paged_bus<Read_hooks>::hook_write(int page, Writer w, void *ctx)
+{
+	write_[page] = nullptr;
+	hooks_[page].on_write = w;
+	hooks_[page].write_ctx = ctx;
+}
+
+template <bool Read_hooks>
+inline uint8_t Basic_paged_bus<Read_hooks>::read(uint16_t adr) const
+{
+	const uint8_t *p {read_[adr / page_size]};
+	if constexpr (Read_hooks)
+	{
+		if (!p)
+		{
+			const Hooks &h {hooks_[adr / page_size]};
+			return h.on_read(h.read_ctx, adr);
+		}
+	}
+	return p[adr % page_size];
+}
+
+template <bool Read_hooks>
+inline void Basic_paged_bus<Read_hooks>::write(uint16_t adr, uint8_t val)
+{
+	uint8_t *p {write_[adr / page_size]};
+	if (p)
+	{
+		p[adr % page_size] = val;
+		return;
+	}
+	const Hooks &h {hooks_[adr / page_size]};
+	h.on_write(h.write_ctx, adr, val);
+}
+
+template <bool Read_hooks>
+inline const uint8_t *Basic_paged_bus<Read_hooks>::fetch(uint16_t adr, uint8_t *buf) const
+{
+	const uint8_t *p {read_[adr / page_size]};
+	if ((!Read_hooks || p) && adr % page_size <= page_size - 3)
+		return p + adr % page_size;
+	for (int i {0}; i < 3; ++i)
+		buf[i] = read(adr + i);
+	return buf;
+}
+
+}
@@ -3,33 +3,88 @@
 #include <cstdint>
 #include <array>
 #include <iostream>
-#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bus.hpp"
+#include "io.hpp"
+#include "jit.hpp"
 
 namespace i8080
 {
 	
 class Test;
 
-struct Condition_flags
+// the flags in the byte PUSH PSW stores: S Z 0 AC 0 P 1 CY
+constexpr uint8_t cy_flag {0x01};
+constexpr uint8_t p_flag {0x04};
+constexpr uint8_t ac_flag {0x10};
+constexpr uint8_t z_flag {0x40};
+constexpr uint8_t s_flag {0x80};
+constexpr uint8_t psw_fixed {0x02}; // always set
+constexpr uint8_t psw_mask {cy_flag | p_flag | ac_flag | z_flag | s_flag};
+
+// everything in a Cpu but its memory and handlers, for save states
+struct Cpu_state
+{
+	uint8_t b, c, d, e, h, l, a;
+	uint16_t sp, pc;
+	uint8_t psw; // the flags
+	uint64_t cycles;
+	bool int_enabled, int_pending;
+	uint8_t int_op;
+	bool halted;
+};
+
+// instruction dispatch engines
+enum class Dispatch
 {
-	bool z, s, p, cy, ac;
+	switch_case, // one big switch, one instruction per call
+	threaded, // computed goto on GCC/Clang, a function pointer table elsewhere
+	block, // basic blocks decoded once and cached by address
+	jit // those blocks translated to x86-64, or the block engine elsewhere
 };
 
+#if defined(__GNUC__) && !defined(I8080_NO_COMPUTED_GOTO)
+	#define I8080_COMPUTED_GOTO
+#endif
+
+// build with -DI8080_THREADED to make the threaded engine the default
+#ifdef I8080_THREADED
+	constexpr Dispatch default_dispatch {Dispatch::threaded};
+#else
+	constexpr Dispatch default_dispatch {Dispatch::switch_case};
+#endif
+
+// mnemonic and length of every opcode
+extern const std::array<std::pair<std::string, int>, 256> op_codes;
+// cycles of every opcode, the longer ones for conditional calls and returns
+extern const std::array<uint8_t, 256> op_cycles;
+
+// Bus is the memory policy, see bus.hpp, and Io handles IN and OUT, see
+// io.hpp. Cpu<Flat_bus>, Cpu<Paged_bus> and Cpu<Read_hook_bus> with
+// Function_io are compiled in cpu.cpp; other combinations get instantiated
+// where they are used.
+template <class Bus = Flat_bus, class Io = Function_io>
 class Cpu
 {
 	public:
 	
-	explicit Cpu(std::array<uint8_t, 0x10000> &a);
-	explicit Cpu(std::array<uint8_t, 0x10000> &a,
-				 std::function<uint8_t(uint8_t)> in,
-				 std::function<void(uint8_t, uint8_t)> out);
+	explicit Cpu(Bus bus, Dispatch d = default_dispatch);
+	explicit Cpu(Bus bus, Io io, Dispatch d = default_dispatch);
 
 	void interrupt(uint8_t op);
 	int emulate_op();
+	int run_until(uint64_t deadline);
+	int run_for(int cyc);
+	
+	Dispatch dispatch() const;
 	
 	void set_pc(uint16_t x);
 	uint16_t pc() const;
-	int cycles() const;
+	uint64_t cycles() const;
 	uint8_t b() const;
 	uint8_t c() const;
 	uint8_t d() const;
@@ -37,6 +92,19 @@ class Cpu
 	uint8_t h() const;
 	uint8_t l() const;
 	uint16_t pair(uint8_t r1, uint8_t r2);
+	Bus &bus();
+	Io &io();
+	
+	Cpu_state state() const;
+	void set_state(const Cpu_state &s);
+	
+	// the block engine sees the cpu's own writes; memory changed any other
+	// way (loading a state, a mirror of the page, a Flat_bus's array) needs
+	// this to drop the code decoded from it
+	void invalidate_blocks();
+	// writes memory as the cpu's own stores do, dropping the code decoded
+	// from the page it lands in
+	void write(uint16_t adr, uint8_t val);
 	
 	// debug functions
 	#ifdef DEBUG
@@ -48,21 +116,47 @@ class Cpu
 	
 	private:
 	
-	std::function<uint8_t(uint8_t)> in_handle_ {};
-	std::function<void(uint8_t, uint8_t)> out_handle_ {};
+	Io io_ {};
 	
 	
 	uint8_t b_ {0}, c_ {0}, d_ {0}, e_ {0}, h_ {0}, l_ {0}, a_ {0}; // registers
 	uint16_t sp_ {0}, pc_ {0}; // stack pointer, program counter
-	Condition_flags cf_ {}; // condition flags
-	std::array<uint8_t, 0x10000> &mem_; // 64k ram addressing
-	int cycles_ {0};
+	uint8_t psw_ {psw_fixed}; // condition flags, see lazy_
+	Bus bus_; // 64k addressing
+	uint64_t cycles_ {0};
+	Dispatch dispatch_;
 	
 	bool int_enabled_ {false};
 	bool int_pending_ {false};
 	uint8_t int_op_ {0};
 	bool halted_ {false};
 	
+	// Z, S, P and AC as the last instruction that set them left them, worked
+	// out only when something reads them; CY is always kept in psw_
+	struct Lazy_flags
+	{
+		uint16_t res; // 16 bits wide for a difference
+		uint8_t aux; // AC is bit 4 of aux ^ res
+		bool pending; // false when psw_ holds them
+	};
+	Lazy_flags lazy_ {0, 0, false};
+	
+	struct Block_cache;
+	std::unique_ptr<Block_cache> blocks_; // made by the block engine's first run
+	
+	// dispatch engines
+	int switch_op();
+	int threaded(uint64_t deadline);
+	int run_blocks(uint64_t deadline);
+	void run_jit(uint64_t deadline);
+	template <uint8_t Op> void exec(const uint8_t *opcode);
+	template <uint8_t Op> static void run(Cpu &cpu, const uint8_t *opcode);
+	
+	void store(uint16_t adr, uint8_t val);
+	Jit_layout jit_layout() const;
+	static uint8_t jit_read(void *cpu, uint16_t adr);
+	static bool jit_write(void *cpu, uint16_t adr, uint8_t val);
+	
 	// instructions
 	void mov(uint8_t &r1, uint8_t r2);
 	void mov_r(uint8_t &r);
@@ -146,9 +240,29 @@ class Cpu
 	void nop();
 	
 	// helper functions
+	bool zero() const;
+	bool sign() const;
+	bool parity_even() const;
+	bool aux_carry() const;
+	bool carry() const;
+	void set_carry(bool cy);
+	uint8_t psw() const;
+	void settle_flags();
 	void set_flags(uint8_t res);
 	void sum_flags(uint8_t a, uint8_t b, uint8_t cy = 0);
 	void dif_flags(uint8_t a, uint8_t b, uint8_t cy = 0);
 };
 
+}
+
+#include "cpu_impl.hpp"
+#include "instructions_impl.hpp"
+
+namespace i8080
+{
+
+extern template class Cpu<Flat_bus>;
+extern template class Cpu<Paged_bus>;
+extern template class Cpu<Read_hook_bus>;
+
 }
\ No newline at end of file
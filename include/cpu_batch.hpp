@@ -0,0 +1,1027 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "cpu.hpp"
+
+namespace i8080
+{
+
+// Runs a batch of Cpus in lockstep. The registers, flags and program
+// counters of every lane live here in struct-of-arrays form, one array per
+// register, and an instruction runs for all lanes at once, a pack of eight
+// lanes per SIMD operation. Each step takes the lowest program counter
+// among the lanes still running and executes its instruction for every lane
+// at that address; the other lanes sit the step out and catch up later,
+// which brings lanes back together after a branch goes different ways.
+//
+// Register, immediate and jump instructions run on the arrays; loads,
+// stores, calls and the stack go lane by lane through each lane's own bus
+// (stores through Cpu::write, so a lane running the block engine or the jit
+// drops the code they overwrite), and IN and OUT through its port handler (while the Cpu's own cycle
+// counter lags behind). The rest (EI, DI, HLT, RST, DAA, ...) copies the
+// lane back into its Cpu and runs the one instruction there, as do
+// interrupts.
+//
+// All lanes must run the same program with the same code at the same
+// addresses: instructions and their operands are fetched from one lane for
+// all of them.
+template <class Bus = Flat_bus, class Io = Function_io>
+class Cpu_batch
+{
+	public:
+	explicit Cpu_batch(std::vector<Cpu<Bus, Io> *> cpus);
+
+	size_t size() const;
+	// runs every lane until its cycle counter reaches its deadline, like
+	// Cpu::run_until
+	void run_until(const std::vector<uint64_t> &deadlines);
+
+	// lane instructions run here and in the Cpus
+	uint64_t lockstep_instructions {0};
+	uint64_t scalar_instructions {0};
+
+	private:
+	static constexpr size_t lane_block {8}; // lanes are padded to whole packs
+	static constexpr uint16_t max_budget {0xFF00}; // cycles per pass, so elapsed_ fits 16 bits
+	static constexpr uint32_t no_lane {0x10000}, unknown {0x20000}; // for next_
+	enum Reg { b, c, d, e, h, l, m, a }; // in the order of the opcode fields
+
+	std::vector<Cpu<Bus, Io> *> cpus_;
+	size_t width_;
+
+	// per lane, padded to width_
+	std::vector<uint8_t> regs_; // eight arrays of width_, indexed by Reg (m unused)
+	std::vector<uint8_t> z_, s_, p_, cy_, ac_;
+	std::vector<uint16_t> sp_, pc_;
+	std::vector<uint16_t> elapsed_, budget_; // cycles since load(), and until the deadline
+	std::vector<uint8_t> active_; // still running here
+	std::vector<uint8_t> mask_; // at the address of this step
+	std::vector<uint8_t> operand_; // a byte read from memory, or the second alu operand
+	std::vector<uint64_t> base_, deadline_; // cycle counter at load(), and the deadline
+	uint32_t next_ {unknown}; // lowest pc of the running lanes, as finish() leaves them
+
+	uint8_t *reg(int r);
+	void load(size_t i);
+	void store(size_t i);
+	uint32_t lowest();
+	bool step();
+	void scalar();
+	bool lockstep(const uint8_t *op);
+	bool condition(int cond, size_t i);
+
+	void finish(int cycles, int length);
+	void mov(int dst, const uint8_t *src);
+	void fill(int dst, uint8_t val);
+	template <int Kind> void alu(int cycles, int length);
+	void inr(uint8_t *x);
+	void dcr(uint8_t *x);
+	void inx(int hi, int lo, int step);
+	void dad(int hi, int lo);
+	template <int Kind> void rotate();
+	void jump(int cond, uint16_t adr);
+	void read_operand(int hi, int lo);
+	void write(int hi, int lo, const uint8_t *val);
+	void push(int hi, int lo);
+	void pop(int hi, int lo);
+	void call(int cond, uint16_t adr);
+	void ret(int cond);
+};
+
+// definitions; templates like cpu.hpp, so they live here
+
+namespace batch_detail
+{
+
+// Lanes go through the arrays in packs: GCC and Clang vector types of eight
+// lanes, which compile to whatever SIMD the target has, or single lanes
+// elsewhere. Eight keeps the 16-bit packs to one SSE or NEON register.
+// Lane values are initialized with = rather than braces, since with single
+// lanes they go through int.
+#if defined(__GNUC__) && !defined(I8080_NO_LANE_VECTORS)
+	constexpr size_t pack {8};
+	using U8 = uint8_t __attribute__((vector_size(pack)));
+	using U16 = uint16_t __attribute__((vector_size(2 * pack)));
+
+	template <class To, class From>
+	To cast(From x)
+	{
+		return __builtin_convertvector(x, To);
+	}
+#else
+	constexpr size_t pack {1};
+	using U8 = uint8_t;
+	using U16 = uint16_t;
+
+	template <class To, class From>
+	To cast(From x)
+	{
+		return static_cast<To>(x);
+	}
+#endif
+
+template <class T>
+T get(const void *p)
+{
+	T x;
+	std::memcpy(&x, p, sizeof x);
+	return x;
+}
+
+template <class T>
+void put(void *p, T x)
+{
+	std::memcpy(p, &x, sizeof x);
+}
+
+// 0 or 1 per lane from a comparison, which gives all ones in vectors
+template <class C>
+U8 flag(C cond)
+{
+	return cast<U8>(cond) & 1;
+}
+
+inline U8 select(U8 on, U8 x, U8 y)
+{
+	return on ? x : y;
+}
+
+inline U16 select(U8 on, U16 x, U16 y)
+{
+	return cast<U16>(on) ? x : y;
+}
+
+// Shifts of bytes have no SSE instruction and come out lane by lane, so
+// these work on 16-bit lanes or masks instead.
+
+// bit 7, as the S flag
+inline U8 sign(U8 x)
+{
+	return flag((x & 0x80) != 0);
+}
+
+// even parity, as the P flag
+inline U8 parity(U8 x)
+{
+	U16 w = cast<U16>(x);
+	w ^= w >> 4;
+	w ^= w >> 2;
+	w ^= w >> 1;
+	return cast<U8>(~w & 1);
+}
+
+}
+
+template <class Bus, class Io>
+Cpu_batch<Bus, Io>::Cpu_batch(std::vector<Cpu<Bus, Io> *> cpus)
+	: cpus_ {std::move(cpus)},
+	  width_ {(cpus_.size() + lane_block - 1) / lane_block * lane_block},
+	  regs_(8 * width_),
+	  z_(width_), s_(width_), p_(width_), cy_(width_), ac_(width_),
+	  sp_(width_), pc_(width_),
+	  elapsed_(width_), budget_(width_),
+	  active_(width_), mask_(width_), operand_(width_),
+	  base_(width_), deadline_(width_)
+{
+}
+
+template <class Bus, class Io>
+size_t Cpu_batch<Bus, Io>::size() const
+{
+	return cpus_.size();
+}
+
+template <class Bus, class Io>
+uint8_t *Cpu_batch<Bus, Io>::reg(int r)
+{
+	return &regs_[r * width_];
+}
+
+// copies lane i out of its Cpu, running any pending interrupt there first
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::load(size_t i)
+{
+	Cpu<Bus, Io> &cpu {*cpus_[i]};
+	Cpu_state st {cpu.state()};
+	if (st.int_pending && !st.halted && st.cycles < deadline_[i])
+	{
+		cpu.emulate_op();
+		++scalar_instructions;
+		st = cpu.state();
+	}
+	const uint8_t r[8] {st.b, st.c, st.d, st.e, st.h, st.l, 0, st.a};
+	for (int k {0}; k < 8; ++k)
+		reg(k)[i] = r[k];
+	z_[i] = (st.psw & z_flag) != 0;
+	s_[i] = (st.psw & s_flag) != 0;
+	p_[i] = (st.psw & p_flag) != 0;
+	cy_[i] = (st.psw & cy_flag) != 0;
+	ac_[i] = (st.psw & ac_flag) != 0;
+	sp_[i] = st.sp;
+	pc_[i] = st.pc;
+	base_[i] = st.cycles;
+	elapsed_[i] = 0;
+	// far deadlines take several passes
+	budget_[i] = st.cycles < deadline_[i] ? std::min<uint64_t>(deadline_[i] - st.cycles, max_budget) : 0;
+	active_[i] = budget_[i] > 0 && !st.halted;
+}
+
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::store(size_t i)
+{
+	Cpu<Bus, Io> &cpu {*cpus_[i]};
+	Cpu_state st {cpu.state()};
+	st.b = reg(b)[i];
+	st.c = reg(c)[i];
+	st.d = reg(d)[i];
+	st.e = reg(e)[i];
+	st.h = reg(h)[i];
+	st.l = reg(l)[i];
+	st.a = reg(a)[i];
+	st.psw = psw_fixed | (z_[i] ? z_flag : 0) | (s_[i] ? s_flag : 0) | (p_[i] ? p_flag : 0)
+		| (cy_[i] ? cy_flag : 0) | (ac_[i] ? ac_flag : 0);
+	st.sp = sp_[i];
+	st.pc = pc_[i];
+	st.cycles = base_[i] + elapsed_[i];
+	cpu.set_state(st);
+}
+
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::run_until(const std::vector<uint64_t> &deadlines)
+{
+	std::copy(deadlines.begin(), deadlines.end(), deadline_.begin());
+	bool again {true};
+	while (again)
+	{
+		for (size_t i {0}; i < cpus_.size(); ++i)
+			load(i);
+		next_ = unknown;
+		while (step())
+			;
+		again = false;
+		for (size_t i {0}; i < cpus_.size(); ++i)
+		{
+			store(i);
+			again |= budget_[i] == max_budget;
+		}
+	}
+	for (size_t i {0}; i < cpus_.size(); ++i)
+		cpus_[i]->run_until(deadlines[i]); // idles halted lanes up to the deadline
+}
+
+namespace batch_detail
+{
+
+// folds the per-lane minimums of a pack into one pc, or no_lane
+inline uint32_t lowest_of(U16 lowest, U8 any, uint32_t no_lane)
+{
+	uint16_t lowest_lanes[pack];
+	uint8_t any_lanes[pack];
+	put(lowest_lanes, lowest);
+	put(any_lanes, any);
+	if (std::find(any_lanes, any_lanes + pack, 1) == any_lanes + pack)
+		return no_lane;
+	return *std::min_element(lowest_lanes, lowest_lanes + pack);
+}
+
+}
+
+// the lowest pc among the running lanes, or no_lane
+template <class Bus, class Io>
+uint32_t Cpu_batch<Bus, Io>::lowest()
+{
+	using namespace batch_detail;
+	const uint8_t *act {active_.data()};
+	const uint16_t *pc {pc_.data()};
+	U8 any = get<U8>(act) * 0;
+	U16 lowest_pack = get<U16>(pc) * 0 + 0xFFFF;
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+	{
+		U8 on = get<U8>(act + k);
+		U16 x = select(on, get<U16>(pc + k), lowest_pack);
+		lowest_pack = x < lowest_pack ? x : lowest_pack;
+		any |= on;
+	}
+	return lowest_of(lowest_pack, any, no_lane);
+}
+
+// runs one instruction for the lanes at the lowest address; false once no
+// lane is running
+template <class Bus, class Io>
+bool Cpu_batch<Bus, Io>::step()
+{
+	using namespace batch_detail;
+	uint32_t at {next_ == unknown ? lowest() : next_};
+	next_ = unknown;
+	if (at == no_lane)
+		return false;
+	const uint8_t *act {active_.data()};
+	const uint16_t *pc {pc_.data()};
+	uint8_t *mk {mask_.data()};
+	size_t n {width_};
+	uint16_t adr = at;
+	U16 count = get<U16>(pc) * 0;
+	for (size_t k {0}; k < n; k += pack)
+	{
+		U8 on = get<U8>(act + k) & flag(get<U16>(pc + k) == adr);
+		put(mk + k, on);
+		count += cast<U16>(on);
+	}
+	uint16_t count_lanes[pack];
+	put(count_lanes, count);
+	size_t first {static_cast<size_t>(std::find(mk, mk + n, 1) - mk)};
+	uint8_t fetched[3];
+	const uint8_t *op {cpus_[first]->bus().fetch(adr, fetched)};
+	if (lockstep(op))
+		lockstep_instructions += std::accumulate(count_lanes, count_lanes + pack, uint64_t {0});
+	else
+		scalar();
+	return true;
+}
+
+// runs the instruction in the Cpu of each lane in mask_
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::scalar()
+{
+	for (size_t i {0}; i < cpus_.size(); ++i)
+	{
+		if (!mask_[i])
+			continue;
+		store(i);
+		cpus_[i]->emulate_op();
+		++scalar_instructions;
+		load(i);
+	}
+}
+
+// NZ, Z, NC, C, PO, PE, P, M by the opcode field
+template <class Bus, class Io>
+bool Cpu_batch<Bus, Io>::condition(int cond, size_t i)
+{
+	const std::vector<uint8_t> *flags[4] {&z_, &cy_, &p_, &s_};
+	return (*flags[cond / 2])[i] == (cond & 1);
+}
+
+// Runs the instruction at op for the lanes in mask_, or returns false if it
+// has to run in the Cpus. Cycle counts and flag effects follow
+// instructions_impl.hpp exactly, quirks included.
+template <class Bus, class Io>
+bool Cpu_batch<Bus, Io>::lockstep(const uint8_t *op)
+{
+	uint8_t x {op[0]};
+	uint16_t adr {static_cast<uint16_t>(op[2] << 8 | op[1])};
+	int dst {x >> 3 & 7}, src {x & 7};
+	int pair {x >> 4 & 3}; // BC, DE, HL, SP (PSW for PUSH and POP)
+	int hi {2 * pair}, lo {2 * pair + 1};
+	if (x >= 0x40 && x < 0x80 && x != 0x76) // MOV
+	{
+		if (src == m)
+			read_operand(h, l);
+		if (dst == m)
+			write(h, l, reg(src));
+		else
+			mov(dst, src == m ? operand_.data() : reg(src));
+		finish(src == m || dst == m ? 7 : 5, 1);
+		return true;
+	}
+	if (x >= 0x80 && x < 0xC0) // ADD ... CMP
+	{
+		if (src == m)
+			read_operand(h, l);
+		else
+			std::copy_n(reg(src), width_, operand_.begin());
+		int cycles {src == m ? 7 : 4};
+		switch (dst)
+		{
+			case 0: alu<0>(cycles, 1); break;
+			case 1: alu<1>(cycles, 1); break;
+			case 2: alu<2>(cycles, 1); break;
+			case 3: alu<3>(cycles, 1); break;
+			case 4: alu<4>(cycles, 1); break;
+			case 5: alu<5>(cycles, 1); break;
+			case 6: alu<6>(cycles, 1); break;
+			case 7: alu<7>(cycles, 1); break;
+		}
+		return true;
+	}
+	switch (x & 0xC7)
+	{
+		case 0xC6: // ADI ... CPI
+			std::fill(operand_.begin(), operand_.end(), op[1]);
+			switch (dst)
+			{
+				case 0: alu<0>(7, 2); break;
+				case 1: alu<1>(7, 2); break;
+				case 2: alu<2>(7, 2); break;
+				case 3: alu<3>(7, 2); break;
+				case 4: alu<4>(7, 2); break;
+				case 5: alu<5>(7, 2); break;
+				case 6: alu<6>(7, 2); break;
+				case 7: alu<7>(7, 2); break;
+			}
+			return true;
+		case 0x06: // MVI
+			if (dst == m)
+			{
+				std::fill(operand_.begin(), operand_.end(), op[1]);
+				write(h, l, operand_.data());
+				finish(10, 2);
+			}
+			else
+			{
+				fill(dst, op[1]);
+				finish(7, 2);
+			}
+			return true;
+		case 0x04: // INR
+			if (dst == m)
+			{
+				read_operand(h, l);
+				inr(operand_.data());
+				write(h, l, operand_.data());
+			}
+			else
+				inr(reg(dst));
+			finish(dst == m ? 10 : 5, 1);
+			return true;
+		case 0x05: // DCR
+			if (dst == m)
+			{
+				read_operand(h, l);
+				dcr(operand_.data());
+				write(h, l, operand_.data());
+			}
+			else
+				dcr(reg(dst));
+			finish(dst == m ? 10 : 5, 1);
+			return true;
+		case 0xC2: // Jcc
+			jump(dst, adr);
+			finish(10, 0);
+			return true;
+		case 0xC4: // Ccc
+			call(dst, adr);
+			return true;
+		case 0xC0: // Rcc
+			ret(dst);
+			return true;
+	}
+	switch (x)
+	{
+		case 0x00: case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+		case 0xCB: case 0xD9: case 0xDD: case 0xED: case 0xFD:
+			finish(4, 1);
+			return true;
+		case 0x01: case 0x11: case 0x21: // LXI
+			fill(hi, op[2]);
+			fill(lo, op[1]);
+			finish(10, 3);
+			return true;
+		case 0x31: // LXI SP
+			for (size_t i {0}; i < width_; ++i)
+				sp_[i] = mask_[i] ? adr : sp_[i];
+			finish(10, 3);
+			return true;
+		case 0x03: case 0x13: case 0x23: case 0x33: // INX
+			inx(hi, lo, 1);
+			finish(5, 1);
+			return true;
+		case 0x0B: case 0x1B: case 0x2B: case 0x3B: // DCX
+			inx(hi, lo, -1);
+			finish(5, 1);
+			return true;
+		case 0x09: case 0x19: case 0x29: case 0x39: // DAD
+			dad(hi, lo);
+			finish(10, 1);
+			return true;
+		case 0x07: // RLC
+			rotate<0>();
+			finish(4, 1);
+			return true;
+		case 0x0F: // RRC
+			rotate<1>();
+			finish(4, 1);
+			return true;
+		case 0x17: // RAL
+			rotate<2>();
+			finish(4, 1);
+			return true;
+		case 0x1F: // RAR
+			rotate<3>();
+			finish(4, 1);
+			return true;
+		case 0x2F: // CMA
+			std::transform(reg(a), reg(a) + width_, operand_.begin(), [](uint8_t v) { return ~v; });
+			mov(a, operand_.data());
+			finish(4, 1);
+			return true;
+		case 0x37: // STC
+			for (size_t i {0}; i < width_; ++i)
+				cy_[i] |= mask_[i];
+			finish(4, 1);
+			return true;
+		case 0x3F: // CMC
+			for (size_t i {0}; i < width_; ++i)
+				cy_[i] ^= mask_[i];
+			finish(4, 1);
+			return true;
+		case 0xEB: // XCHG
+			std::copy_n(reg(h), width_, operand_.begin());
+			mov(h, reg(d));
+			mov(d, operand_.data());
+			std::copy_n(reg(l), width_, operand_.begin());
+			mov(l, reg(e));
+			mov(e, operand_.data());
+			finish(4, 1);
+			return true;
+		case 0xC3: // JMP
+			jump(-1, adr);
+			finish(10, 0);
+			return true;
+		case 0x0A: case 0x1A: // LDAX
+			read_operand(hi, lo);
+			mov(a, operand_.data());
+			finish(7, 1);
+			return true;
+		case 0x02: case 0x12: // STAX
+			write(hi, lo, reg(a));
+			finish(7, 1);
+			return true;
+		case 0x3A: // LDA
+			for (size_t i {0}; i < cpus_.size(); ++i)
+				if (mask_[i])
+					reg(a)[i] = cpus_[i]->bus().read(adr);
+			finish(13, 3);
+			return true;
+		case 0x32: // STA
+			for (size_t i {0}; i < cpus_.size(); ++i)
+				if (mask_[i])
+					cpus_[i]->write(adr, reg(a)[i]);
+			finish(13, 3);
+			return true;
+		case 0x2A: // LHLD
+			for (size_t i {0}; i < cpus_.size(); ++i)
+			{
+				if (!mask_[i])
+					continue;
+				reg(l)[i] = cpus_[i]->bus().read(adr);
+				reg(h)[i] = cpus_[i]->bus().read(adr + 1);
+			}
+			finish(16, 3);
+			return true;
+		case 0x22: // SHLD
+			for (size_t i {0}; i < cpus_.size(); ++i)
+			{
+				if (!mask_[i])
+					continue;
+				cpus_[i]->write(adr, reg(l)[i]);
+				cpus_[i]->write(adr + 1, reg(h)[i]);
+			}
+			finish(16, 3);
+			return true;
+		case 0xE3: // XTHL
+			for (size_t i {0}; i < cpus_.size(); ++i)
+			{
+				if (!mask_[i])
+					continue;
+				Bus &bus {cpus_[i]->bus()};
+				uint8_t tmp {reg(l)[i]};
+				reg(l)[i] = bus.read(sp_[i]);
+				cpus_[i]->write(sp_[i], tmp);
+				tmp = reg(h)[i];
+				reg(h)[i] = bus.read(sp_[i] + 1);
+				cpus_[i]->write(sp_[i] + 1, tmp);
+			}
+			finish(18, 1);
+			return true;
+		case 0xE9: // PCHL
+			for (size_t i {0}; i < width_; ++i)
+				pc_[i] = mask_[i] ? reg(h)[i] << 8 | reg(l)[i] : pc_[i];
+			finish(5, 0);
+			return true;
+		case 0xDB: // IN
+			for (size_t i {0}; i < cpus_.size(); ++i)
+				if (mask_[i])
+					reg(a)[i] = cpus_[i]->io().in(op[1]);
+			finish(10, 2);
+			return true;
+		case 0xD3: // OUT
+			for (size_t i {0}; i < cpus_.size(); ++i)
+				if (mask_[i])
+				{
+					store(i); // the port handler sees the lane's own cycle count, as when it runs alone
+					cpus_[i]->io().out(op[1], reg(a)[i]);
+				}
+			finish(10, 2);
+			return true;
+		case 0xC5: case 0xD5: case 0xE5: case 0xF5: // PUSH
+			push(hi, lo);
+			finish(11, 1);
+			return true;
+		case 0xC1: case 0xD1: case 0xE1: case 0xF1: // POP
+			pop(hi, lo);
+			finish(10, 1);
+			return true;
+		case 0xCD: // CALL
+			call(-1, adr);
+			return true;
+		case 0xC9: // RET
+			ret(-1);
+			return true;
+	}
+	return false;
+}
+
+// advances the lanes in mask_ past an instruction of length bytes (0 when
+// it set the pc itself) and cycles cycles, finding next_ on the way
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::finish(int cycles, int length)
+{
+	using namespace batch_detail;
+	const uint8_t *mk {mask_.data()};
+	uint16_t *pc {pc_.data()};
+	uint16_t *el {elapsed_.data()};
+	const uint16_t *bud {budget_.data()};
+	uint8_t *act {active_.data()};
+	uint16_t len = length, spent = cycles;
+	U8 any = get<U8>(act) * 0;
+	U16 lowest_pack = get<U16>(pc) * 0 + 0xFFFF;
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+	{
+		U16 on = cast<U16>(get<U8>(mk + k));
+		U16 here = get<U16>(pc + k) + on * len;
+		put(pc + k, here);
+		U16 elapsed = get<U16>(el + k) + on * spent;
+		put(el + k, elapsed);
+		U8 running = get<U8>(act + k) & flag(elapsed < get<U16>(bud + k));
+		put(act + k, running);
+		U16 x = select(running, here, lowest_pack);
+		lowest_pack = x < lowest_pack ? x : lowest_pack;
+		any |= running;
+	}
+	next_ = lowest_of(lowest_pack, any, no_lane);
+}
+
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::mov(int dst, const uint8_t *src)
+{
+	using namespace batch_detail;
+	const uint8_t *mk {mask_.data()};
+	uint8_t *r {reg(dst)};
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+		put(r + k, select(get<U8>(mk + k), get<U8>(src + k), get<U8>(r + k)));
+}
+
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::fill(int dst, uint8_t val)
+{
+	using namespace batch_detail;
+	const uint8_t *mk {mask_.data()};
+	uint8_t *r {reg(dst)};
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+	{
+		U8 x = get<U8>(r + k);
+		put(r + k, select(get<U8>(mk + k), x * 0 + val, x));
+	}
+}
+
+// A op operand_, with Kind the opcode field: ADD, ADC, SUB, SBB, ANA, XRA,
+// ORA, CMP
+template <class Bus, class Io>
+template <int Kind>
+void Cpu_batch<Bus, Io>::alu(int cycles, int length)
+{
+	using namespace batch_detail;
+	const uint8_t *mk {mask_.data()}, *operand {operand_.data()};
+	uint8_t *acc {reg(a)};
+	uint8_t *fz {z_.data()}, *fs {s_.data()}, *fp {p_.data()}, *fcy {cy_.data()}, *fac {ac_.data()};
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+	{
+		U8 on = get<U8>(mk + k);
+		U8 x = get<U8>(acc + k), v = get<U8>(operand + k);
+		U8 res, z, s, cy, ac;
+		if constexpr (Kind <= 3 || Kind == 7)
+		{
+			U16 x16 = cast<U16>(x), v16 = cast<U16>(v);
+			U16 carry = x16 * 0;
+			if constexpr (Kind == 1 || Kind == 3)
+				carry = cast<U16>(get<U8>(fcy + k));
+			if constexpr (Kind <= 1)
+			{
+				U16 sum = x16 + v16 + carry;
+				res = cast<U8>(sum);
+				z = flag(res == 0);
+				s = cast<U8>(sum >> 7 & 1);
+				cy = cast<U8>((sum ^ x16 ^ v16) >> 8 & 1);
+				ac = cast<U8>((sum ^ x16 ^ v16) >> 4 & 1);
+			}
+			else
+			{
+				U16 dif = x16 - v16 - carry;
+				res = cast<U8>(dif);
+				z = flag(dif == 0);
+				s = cast<U8>(dif >> 7 & 1);
+				cy = flag(x16 < v16 + carry);
+				ac = flag((~(x16 ^ v16 ^ dif) & 0x10) != 0);
+			}
+		}
+		else
+		{
+			if constexpr (Kind == 4)
+				res = x & v;
+			else if constexpr (Kind == 5)
+				res = x ^ v;
+			else
+				res = x | v;
+			z = flag(res == 0);
+			s = batch_detail::sign(res);
+			cy = x * 0;
+			if constexpr (Kind == 4)
+				ac = flag(((x | v) & 0x08) != 0);
+			else
+				ac = x * 0;
+		}
+		if constexpr (Kind != 7)
+			put(acc + k, select(on, res, x));
+		put(fz + k, select(on, z, get<U8>(fz + k)));
+		put(fs + k, select(on, s, get<U8>(fs + k)));
+		put(fp + k, select(on, batch_detail::parity(res), get<U8>(fp + k)));
+		put(fcy + k, select(on, cy, get<U8>(fcy + k)));
+		put(fac + k, select(on, ac, get<U8>(fac + k)));
+	}
+	finish(cycles, length);
+}
+
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::inr(uint8_t *x)
+{
+	using namespace batch_detail;
+	const uint8_t *mk {mask_.data()};
+	uint8_t *fz {z_.data()}, *fs {s_.data()}, *fp {p_.data()}, *fac {ac_.data()};
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+	{
+		U8 on = get<U8>(mk + k);
+		U8 old = get<U8>(x + k);
+		U8 res = old + 1;
+		put(x + k, select(on, res, old));
+		put(fz + k, select(on, flag(res == 0), get<U8>(fz + k)));
+		put(fs + k, select(on, batch_detail::sign(res), get<U8>(fs + k)));
+		put(fp + k, select(on, batch_detail::parity(res), get<U8>(fp + k)));
+		put(fac + k, select(on, flag((res & 0x0F) == 0), get<U8>(fac + k)));
+	}
+}
+
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::dcr(uint8_t *x)
+{
+	using namespace batch_detail;
+	const uint8_t *mk {mask_.data()};
+	uint8_t *fz {z_.data()}, *fs {s_.data()}, *fp {p_.data()}, *fac {ac_.data()};
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+	{
+		U8 on = get<U8>(mk + k);
+		U8 old = get<U8>(x + k);
+		U16 old16 = cast<U16>(old);
+		U16 dif = old16 - 1;
+		U8 res = cast<U8>(dif);
+		put(x + k, select(on, res, old));
+		put(fz + k, select(on, flag(dif == 0), get<U8>(fz + k)));
+		put(fs + k, select(on, batch_detail::sign(res), get<U8>(fs + k)));
+		put(fp + k, select(on, batch_detail::parity(res), get<U8>(fp + k)));
+		put(fac + k, select(on, flag((~(old16 ^ 1 ^ dif) & 0x10) != 0), get<U8>(fac + k)));
+	}
+}
+
+// register pair hi:lo, or the stack pointer for hi == m
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::inx(int hi, int lo, int step)
+{
+	using namespace batch_detail;
+	const uint8_t *mk {mask_.data()};
+	uint16_t delta = step;
+	if (hi == m)
+	{
+		uint16_t *sp {sp_.data()};
+		for (size_t k {0}, n {width_}; k < n; k += pack)
+			put(sp + k, get<U16>(sp + k) + cast<U16>(get<U8>(mk + k)) * delta);
+		return;
+	}
+	uint8_t *x {reg(hi)}, *y {reg(lo)};
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+	{
+		U16 v = (cast<U16>(get<U8>(x + k)) << 8 | cast<U16>(get<U8>(y + k)))
+			+ cast<U16>(get<U8>(mk + k)) * delta;
+		put(x + k, cast<U8>(v >> 8));
+		put(y + k, cast<U8>(v));
+	}
+}
+
+// HL += register pair hi:lo, or the stack pointer for hi == m
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::dad(int hi, int lo)
+{
+	using namespace batch_detail;
+	const uint8_t *mk {mask_.data()};
+	uint8_t *x {reg(h)}, *y {reg(l)}, *fcy {cy_.data()};
+	const uint8_t *ah {hi == m ? x : reg(hi)}, *al {hi == m ? y : reg(lo)};
+	const uint16_t *sp {sp_.data()};
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+	{
+		U8 on = get<U8>(mk + k);
+		U16 hl = cast<U16>(get<U8>(x + k)) << 8 | cast<U16>(get<U8>(y + k));
+		U16 addend = cast<U16>(get<U8>(ah + k)) << 8 | cast<U16>(get<U8>(al + k));
+		if (hi == m)
+			addend = get<U16>(sp + k);
+		U16 sum = hl + addend;
+		put(fcy + k, select(on, flag(sum < hl), get<U8>(fcy + k)));
+		put(x + k, select(on, cast<U8>(sum >> 8), get<U8>(x + k)));
+		put(y + k, select(on, cast<U8>(sum), get<U8>(y + k)));
+	}
+}
+
+// RLC, RRC, RAL, RAR by the opcode field
+template <class Bus, class Io>
+template <int Kind>
+void Cpu_batch<Bus, Io>::rotate()
+{
+	using namespace batch_detail;
+	const uint8_t *mk {mask_.data()};
+	uint8_t *acc {reg(a)}, *fcy {cy_.data()};
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+	{
+		U8 on = get<U8>(mk + k);
+		U8 x = get<U8>(acc + k), old_cy = get<U8>(fcy + k);
+		U16 x16 = cast<U16>(x), cy16 = cast<U16>(old_cy);
+		U16 res;
+		U8 cy;
+		if constexpr (Kind == 0)
+		{
+			res = x16 << 1 | x16 >> 7;
+			cy = batch_detail::sign(x);
+		}
+		else if constexpr (Kind == 1)
+		{
+			res = x16 >> 1 | x16 << 7;
+			cy = x & 1;
+		}
+		else if constexpr (Kind == 2)
+		{
+			res = x16 << 1 | cy16;
+			cy = batch_detail::sign(x);
+		}
+		else
+		{
+			res = x16 >> 1 | cy16 << 7;
+			cy = x & 1;
+		}
+		put(acc + k, select(on, cast<U8>(res), x));
+		put(fcy + k, select(on, cy, old_cy));
+	}
+}
+
+// JMP for cond -1, otherwise Jcc with cond the opcode field
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::jump(int cond, uint16_t adr)
+{
+	using namespace batch_detail;
+	const std::vector<uint8_t> *flags[4] {&z_, &cy_, &p_, &s_};
+	const uint8_t *mk {mask_.data()};
+	// an unconditional jump tests the mask itself, which is 1 wherever it counts
+	const uint8_t *f {cond < 0 ? mk : flags[cond / 2]->data()};
+	uint8_t want = cond < 0 ? 1 : cond & 1;
+	uint16_t *pc {pc_.data()};
+	for (size_t k {0}, n {width_}; k < n; k += pack)
+	{
+		U8 on = get<U8>(mk + k);
+		U16 here = get<U16>(pc + k);
+		U8 taken = flag(get<U8>(f + k) == want);
+		U16 far = here * 0 + adr, near = here + 3;
+		put(pc + k, select(on, select(taken, far, near), here));
+	}
+}
+
+// reads the byte at hi:lo of each lane in mask_ into operand_
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::read_operand(int hi, int lo)
+{
+	const uint8_t *x {reg(hi)}, *y {reg(lo)};
+	for (size_t i {0}; i < cpus_.size(); ++i)
+		if (mask_[i])
+			operand_[i] = cpus_[i]->bus().read(x[i] << 8 | y[i]);
+}
+
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::write(int hi, int lo, const uint8_t *val)
+{
+	const uint8_t *x {reg(hi)}, *y {reg(lo)};
+	for (size_t i {0}; i < cpus_.size(); ++i)
+		if (mask_[i])
+			cpus_[i]->write(x[i] << 8 | y[i], val[i]);
+}
+
+// register pair hi:lo, or PSW for hi == m
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::push(int hi, int lo)
+{
+	for (size_t i {0}; i < cpus_.size(); ++i)
+	{
+		if (!mask_[i])
+			continue;
+		Cpu<Bus, Io> &cpu {*cpus_[i]};
+		uint16_t sp {sp_[i]};
+		if (hi == m)
+		{
+			// flag word : S-Z-0-AC-0-P-1-CY
+			cpu.write(sp - 1, reg(a)[i]);
+			cpu.write(sp - 2, cy_[i] | 0x02 | p_[i] << 2 | ac_[i] << 4 | z_[i] << 6 | s_[i] << 7);
+		}
+		else
+		{
+			cpu.write(sp - 1, reg(hi)[i]);
+			cpu.write(sp - 2, reg(lo)[i]);
+		}
+		sp_[i] = sp - 2;
+	}
+}
+
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::pop(int hi, int lo)
+{
+	for (size_t i {0}; i < cpus_.size(); ++i)
+	{
+		if (!mask_[i])
+			continue;
+		Bus &bus {cpus_[i]->bus()};
+		uint16_t sp {sp_[i]};
+		if (hi == m)
+		{
+			uint8_t word {bus.read(sp)};
+			cy_[i] = word & 1;
+			p_[i] = word >> 2 & 1;
+			ac_[i] = word >> 4 & 1;
+			z_[i] = word >> 6 & 1;
+			s_[i] = word >> 7 & 1;
+			reg(a)[i] = bus.read(sp + 1);
+		}
+		else
+		{
+			reg(hi)[i] = bus.read(sp + 1);
+			reg(lo)[i] = bus.read(sp);
+		}
+		sp_[i] = sp + 2;
+	}
+}
+
+// CALL for cond -1, otherwise Ccc
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::call(int cond, uint16_t adr)
+{
+	for (size_t i {0}; i < cpus_.size(); ++i)
+	{
+		if (!mask_[i])
+			continue;
+		uint16_t next = pc_[i] + 3;
+		if (cond >= 0 && !condition(cond, i))
+		{
+			pc_[i] = next;
+			elapsed_[i] += 11;
+			continue;
+		}
+		uint16_t sp = sp_[i] - 2;
+		cpus_[i]->write(sp + 1, next >> 8);
+		cpus_[i]->write(sp, next & 0xFF);
+		sp_[i] = sp;
+		pc_[i] = adr;
+		elapsed_[i] += 17;
+	}
+	finish(0, 0);
+}
+
+// RET for cond -1, otherwise Rcc
+template <class Bus, class Io>
+void Cpu_batch<Bus, Io>::ret(int cond)
+{
+	for (size_t i {0}; i < cpus_.size(); ++i)
+	{
+		if (!mask_[i])
+			continue;
+		if (cond >= 0 && !condition(cond, i))
+		{
+			++pc_[i];
+			elapsed_[i] += 5;
+			continue;
+		}
+		Bus &bus {cpus_[i]->bus()};
+		uint16_t sp {sp_[i]};
+		pc_[i] = bus.read(sp) | bus.read(sp + 1) << 8;
+		sp_[i] = sp + 2;
+		elapsed_[i] += cond >= 0 ? 11 : 10;
+	}
+	finish(0, 0);
+}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "machine.hpp"
+
+namespace space_invaders
+{
+
+// player 1's controls, as the actions of an agent
+enum class Action
+{
+	noop, fire, left, right, left_fire, right_fire
+};
+
+constexpr int action_count {6};
+
+// a read-only window onto bytes an Env owns, valid until its next step()
+// or reset()
+struct Byte_view
+{
+	const uint8_t *data;
+	size_t size;
+
+	const uint8_t *begin() const { return data; }
+	const uint8_t *end() const { return data + size; }
+	uint8_t operator[](size_t i) const { return data[i]; }
+};
+
+// A reinforcement learning environment around a headless cabinet, gym
+// style: reset() starts a one-player game, step() plays an action for
+// frame_skip frames and scores it by the change of player 1's score. An
+// episode is done when the game is over.
+class Env
+{
+	public:
+	struct Step
+	{
+		int reward;
+		bool done;
+	};
+
+	explicit Env(int frame_skip = 1, i8080::Dispatch d = i8080::default_dispatch);
+
+	// also plays through inserting a coin and pressing start, to the state
+	// reset() goes back to; false if the rom won't load or never starts a game
+	bool load_program(const std::string &in);
+
+	// false, leaving the machine as it was, before a successful
+	// load_program()
+	bool reset();
+	Step step(Action a);
+
+	// video ram in place, 1bpp and rotated as described in video.hpp, with
+	// no copy
+	Byte_view observation();
+	// the screen upright and shrunk by factor, a byte per pixel: 1 where any
+	// pixel of the factor x factor block is lit; blocks in the last row and
+	// column cover what is left of the screen when factor doesn't divide it.
+	// Empty for a factor below 1.
+	Byte_view downsampled(int factor);
+
+	int score();
+	Machine &machine();
+
+	private:
+	Machine machine_;
+	int frame_skip_;
+	int score_ {0};
+	std::vector<uint8_t> start_; // state at the start of a game
+	std::vector<uint8_t> small_; // the last downsampled screen
+
+	uint8_t peek(uint16_t adr);
+};
+
+}
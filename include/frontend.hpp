@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <SDL.h>
+
+#include "machine.hpp"
+#include "audio.hpp"
+#include "movie.hpp"
+#include "rewind.hpp"
+
+namespace space_invaders
+{
+
+// SDL window, keyboard and sound for a cabinet. In turbo mode frames run
+// back to back and the window is only presented at 60 Hz. Holding
+// backspace steps back through the recorded frames.
+//
+// The screen goes up as a streaming texture that the renderer scales to the
+// window, uploading only the columns that changed. Without an accelerated
+// renderer it is scaled by a whole factor in software, straight into the
+// window's surface, and centred.
+class Frontend : public Video_sink, public Audio_sink
+{
+	public:
+	explicit Frontend(bool turbo = false);
+	~Frontend();
+
+	void run(Machine &m, Movie *movie = nullptr); // records the session into movie
+
+	void draw(const uint8_t *vram, const Column_mask &dirty) override;
+	void play(Sound s, uint64_t cycle) override;
+	void stop(Sound s, uint64_t cycle) override;
+
+	private:
+	using Clock = std::chrono::steady_clock;
+	
+	bool done_ {false};
+	bool turbo_;
+	bool rewinding_ {false};
+	Rewind rewind_ {};
+	Clock::time_point last_present_ {};
+	Column_mask pending_ {}; // dirty columns from frames turbo mode skipped
+	SDL_Window *window_;
+	SDL_Renderer *renderer_ {nullptr}; // null without an accelerated renderer
+	SDL_Texture *texture_ {nullptr};
+	SDL_Surface *disp_; // the upright screen, 32 bits a pixel
+	int surface_w_ {0}, surface_h_ {0}; // the window surface's size when last drawn
+	Mixer mixer_ {};
+	Audio_device device_ {mixer_.rate()};
+	Audio_stream stream_;
+
+	bool button(SDL_Keycode k, Button &b);
+	void present(const Column_mask &dirty);
+	void present_software();
+};
+
+}
@@ -0,0 +1,1504 @@
+#pragma once
+
+// instruction definitions for cpu.hpp, included at its end
+
+namespace i8080
+{
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::mov(uint8_t &r1, uint8_t r2)
+{
+	r1 = r2;
+	cycles_ += 5;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::mov_r(uint8_t &r)
+{
+	uint16_t adr {pair(h_, l_)};
+	r = bus_.read(adr);
+	cycles_ += 7;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::mov_m(uint8_t r)
+{
+	uint16_t adr {pair(h_, l_)};
+	store(adr, r);
+	cycles_ += 7;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::mvi(uint8_t &r, uint8_t d)
+{
+	r = d;
+	++pc_;
+	cycles_ += 7;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::mvi_m(uint8_t d)
+{
+	uint16_t adr {pair(h_, l_)};
+	store(adr, d);
+	++pc_;
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::lxi(uint8_t &r1, uint8_t &r2, uint8_t l, uint8_t h)
+{
+	r1 = h;
+	r2 = l;
+	pc_ += 2;
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::lxi(uint16_t &r, uint8_t l, uint8_t h)
+{
+	r = h << 8 | l;
+	pc_ += 2;
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::lda(uint8_t l, uint8_t h)
+{
+	uint16_t adr {pair(h, l)};
+	a_ = bus_.read(adr);
+	pc_ += 2;
+	cycles_ += 13;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::sta(uint8_t l, uint8_t h)
+{
+	uint16_t adr {pair(h, l)};
+	store(adr, a_);
+	pc_ += 2;
+	cycles_ += 13;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::lhld(uint8_t l, uint8_t h)
+{
+	uint16_t adr {pair(h, l)};
+	l_ = bus_.read(adr);
+	h_ = bus_.read(adr+1);
+	pc_ += 2;
+	cycles_ += 16;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::shld(uint8_t l, uint8_t h)
+{
+	uint16_t adr {pair(h, l)};
+	store(adr, l_);
+	store(adr+1, h_);
+	pc_ += 2;
+	cycles_ += 16;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::ldax(uint8_t r1, uint8_t r2)
+{
+	uint16_t adr {pair(r1, r2)};
+	a_ = bus_.read(adr);
+	cycles_ += 7;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::stax(uint8_t r1, uint8_t r2)
+{
+	uint16_t adr {pair(r1, r2)};
+	store(adr, a_);
+	cycles_ += 7;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::xchg()
+{
+	uint8_t tmp {h_};
+	h_ = d_;
+	d_ = tmp;
+	tmp = l_;
+	l_ = e_;
+	e_ = tmp;
+	cycles_ += 4;
+}
+
+// arithmetic group
+
+// S, Z and P of every result, in their PSW bits; the upper half is for
+// differences that borrowed, which are never zero
+constexpr std::array<uint8_t, 512> szp_flags {[]
+{
+	std::array<uint8_t, 512> t {};
+	for (int i {0}; i < 512; ++i)
+	{
+		uint8_t res {static_cast<uint8_t>(i)};
+		int ones {0};
+		for (int bit {0}; bit < 8; ++bit)
+			ones += (res >> bit) & 1;
+		t[i] = (res & s_flag) | (i == 0 ? z_flag : 0) | (ones % 2 == 0 ? p_flag : 0);
+	}
+	return t;
+}()};
+
+template <class Bus, class Io>
+bool Cpu<Bus, Io>::zero() const
+{
+	return lazy_.pending ? lazy_.res == 0 : psw_ & z_flag;
+}
+
+template <class Bus, class Io>
+bool Cpu<Bus, Io>::sign() const
+{
+	return lazy_.pending ? lazy_.res & s_flag : psw_ & s_flag;
+}
+
+template <class Bus, class Io>
+bool Cpu<Bus, Io>::parity_even() const
+{
+	return lazy_.pending ? szp_flags[lazy_.res & 0xFF] & p_flag : psw_ & p_flag;
+}
+
+template <class Bus, class Io>
+bool Cpu<Bus, Io>::aux_carry() const
+{
+	return lazy_.pending ? (lazy_.aux ^ lazy_.res) & ac_flag : psw_ & ac_flag;
+}
+
+template <class Bus, class Io>
+bool Cpu<Bus, Io>::carry() const
+{
+	return psw_ & cy_flag;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::set_carry(bool cy)
+{
+	psw_ = (psw_ & ~cy_flag) | cy;
+}
+
+// the flags as PUSH PSW stores them
+template <class Bus, class Io>
+uint8_t Cpu<Bus, Io>::psw() const
+{
+	if (!lazy_.pending)
+		return psw_;
+	return szp_flags[lazy_.res & 0x1FF] | ((lazy_.aux ^ lazy_.res) & ac_flag)
+		| (psw_ & cy_flag) | psw_fixed;
+}
+
+// writes the lazy flags out to psw_, for code that reads it directly
+template <class Bus, class Io>
+void Cpu<Bus, Io>::settle_flags()
+{
+	psw_ = psw();
+	lazy_.pending = false;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::set_flags(uint8_t res)
+{
+	// for logical operators
+	lazy_ = {res, res, true};
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::sum_flags(uint8_t a, uint8_t b, uint8_t cy)
+{
+	uint16_t sum = static_cast<uint16_t>(a) + static_cast<uint16_t>(b) + cy;
+	lazy_ = {static_cast<uint8_t>(sum), static_cast<uint8_t>(a ^ b), true};
+	set_carry(sum & (1 << 8));
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::dif_flags(uint8_t a, uint8_t b, uint8_t cy)
+{
+	// Z comes from all 16 bits, so SBB only sets it without a borrow
+	uint16_t dif = static_cast<uint16_t>(a) - static_cast<uint16_t>(b) - cy;
+	lazy_ = {dif, static_cast<uint8_t>(~(a ^ b)), true};
+	set_carry(a < (b + cy));
+}
+
+// every write of the instructions, so the block engine can drop code that
+// gets written over
+template <class Bus, class Io>
+void Cpu<Bus, Io>::store(uint16_t adr, uint8_t val)
+{
+	bus_.write(adr, val);
+	if (blocks_ && !blocks_->starts[adr / 0x100].empty())
+		blocks_->drop(adr / 0x100);
+}
+
+
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::add(uint8_t r)
+{
+	sum_flags(a_, r);
+	a_ = a_ + r;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::add_m()
+{
+	add(bus_.read(pair(h_, l_)));
+	cycles_ += 3;
+}
+
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::adi(uint8_t d)
+{
+	add(d);
+	++pc_;
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::adc(uint8_t r)
+{
+	uint8_t cy {carry()};
+	sum_flags(a_, r, cy);
+	a_ = a_ + r + cy;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::adc_m()
+{
+	adc(bus_.read(pair(h_, l_)));
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::aci(uint8_t d)
+{
+	adc(d);
+	++pc_;
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::sub(uint8_t r)
+{
+	dif_flags(a_, r);
+	a_ -= r;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::sub_m()
+{
+	sub(bus_.read(pair(h_, l_)));
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::sui(uint8_t d)
+{
+	sub(d);
+	++pc_;
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::sbb(uint8_t r)
+{
+	uint8_t cy {carry()};
+	dif_flags(a_, r, cy);
+	a_ = a_ - r - cy;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::sbb_m()
+{
+	sbb(bus_.read(pair(h_, l_)));
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::sbi(uint8_t d)
+{
+	sbb(d);
+	++pc_;
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::inr(uint8_t &r)
+{
+	bool cy {carry()};
+	sum_flags(r, 1);
+	set_carry(cy); // INR doesn't affect the cy flag
+	++r;
+	cycles_ += 5;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::inr_m()
+{
+	uint16_t adr {pair(h_, l_)};
+	uint8_t m {bus_.read(adr)};
+	inr(m);
+	store(adr, m);
+	cycles_ += 5;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::dcr(uint8_t &r)
+{
+	bool cy {carry()};
+	dif_flags(r, 1);
+	set_carry(cy); // DCR doesn't affect the cy flag
+	--r;
+	cycles_ += 5;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::dcr_m()
+{
+	uint16_t adr {pair(h_, l_)};
+	uint8_t m {bus_.read(adr)};
+	dcr(m);
+	store(adr, m);
+	cycles_ += 5;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::inx(uint8_t &r1, uint8_t &r2)
+{
+	++r2;
+	if (r2 == 0)
+		++r1;
+	cycles_ += 5;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::inx(uint16_t &r)
+{
+	++r;
+	cycles_ += 5;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::dcx(uint8_t &r1, uint8_t &r2)
+{
+	if (r2 == 0)
+	{
+		--r2;
+		--r1;
+	}
+	else
+		--r2;
+	cycles_ += 5;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::dcx(uint16_t &r)
+{
+	--r;
+	cycles_ += 5;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::dad(uint8_t r1, uint8_t r2)
+{
+	uint32_t sum = static_cast<uint32_t>(pair(h_, l_))
+		+ static_cast<uint32_t>(pair(r1, r2));
+	set_carry((sum > 0xFFFF));
+	uint16_t res = pair(h_, l_) + pair(r1, r2);
+	l_ = static_cast<uint8_t>(res & 0xFF);
+	h_ = static_cast<uint8_t>((res & 0xFF00) >> 8);
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::dad(uint16_t r)
+{
+	uint32_t sum = static_cast<uint32_t>(r) + static_cast<uint32_t>(pair(h_, l_));
+	set_carry((sum > 0xFFFF));
+	uint16_t res = pair(h_, l_) + r;
+	l_ = static_cast<uint8_t>(res & 0xFF);
+	h_ = static_cast<uint8_t>((res & 0xFF00) >> 8);
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::daa()
+{
+	uint64_t old_cycles {cycles_};
+	bool old_carry {carry()};
+	uint16_t old_pc {pc_};
+	uint8_t adjust {0x0};
+	const uint8_t lsb = a_ & 0x0F;
+	const uint8_t msb = a_ >> 4;
+	// if the value of the least significant 4 bits of the accumulator is
+	// greater than 9 or if the AC flag is set, 6 is added to the accumulator
+	if ((lsb > 9) || aux_carry())
+		adjust += 0x06;
+	// if the value of the most significant 4 bits of the accumulator is now
+	// greater than 9 or if the AC flag is set, 6 is added to the most
+	// significant 4 bits of the accumulator
+	if ((msb > 9) || ((msb >= 9) && (lsb > 9)) || carry())
+	{
+		adjust += 0x60;
+		old_carry = 1;
+	}
+	adi(adjust);
+	cycles_ = old_cycles + 4;
+	pc_ = old_pc;
+	set_carry(old_carry);
+}
+
+// logical group
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::ana(uint8_t r)
+{
+	// for some reason, according to 8085 manual, AC flag is set here for ANA
+	// based on the logical OR of bits 3 of the operands
+	// http://www.nj7p.org/Manuals/PDFs/Intel/9800301D.pdf p.22
+	uint8_t res {static_cast<uint8_t>(a_ & r)};
+	lazy_ = {res, static_cast<uint8_t>(res ^ ((a_ | r) & 0x08) << 1), true};
+	set_carry(0);
+	a_ &= r;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::ana_m()
+{
+	uint16_t adr {pair(h_, l_)};
+	ana(bus_.read(adr));
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::ani(uint8_t d)
+{
+	ana(d);
+	set_carry(0);
+	pc_++;
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::xra(uint8_t r)
+{
+	set_flags(a_ ^ r);
+	set_carry(0);
+	a_ ^= r;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::xra_m()
+{
+	uint16_t adr {pair(h_, l_)};
+	xra(bus_.read(adr));
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::xri(uint8_t d)
+{
+	xra(d);
+	pc_++;
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::ora(uint8_t r)
+{
+	set_flags(a_ | r);
+	set_carry(0);
+	a_ |= r;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::ora_m()
+{
+	uint16_t adr {pair(h_, l_)};
+	ora(bus_.read(adr));
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::ori(uint8_t d)
+{
+	ora(d);
+	pc_++;
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::cmp(uint8_t r)
+{
+	dif_flags(a_, r);
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::cmp_m()
+{
+	uint16_t adr {pair(h_, l_)};
+	dif_flags(a_, bus_.read(adr));
+	cycles_ += 7;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::cpi(uint8_t d)
+{
+	cmp(d);
+	++pc_;
+	cycles_ += 3;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::rlc()
+{
+	uint8_t high_bit = (a_ & 0x80) >> 7;
+	a_ <<= 1;
+	set_carry(high_bit);
+	a_ |= high_bit;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::rrc()
+{
+	uint8_t low_bit = (a_ & 0x01);
+	a_ >>= 1;
+	set_carry(low_bit);
+	a_ |= (low_bit << 7);
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::ral()
+{
+	uint8_t high_bit = (a_ & 0x80) >> 7;
+	a_ <<= 1;
+	a_ |= carry();
+	set_carry(high_bit);
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::rar()
+{
+	uint8_t low_bit = a_ & 0x01;
+	a_ >>= 1;
+	a_ |= (carry() << 7);
+	set_carry(low_bit);
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::cma()
+{
+	a_ = ~a_;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::cmc()
+{
+	psw_ ^= cy_flag;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::stc()
+{
+	set_carry(1);
+	cycles_ += 4;
+}
+
+// branch group
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::jmp(uint8_t l, uint8_t h)
+{
+	uint16_t adr {pair(h, l)};
+	pc_ = adr-1; // emulate_op increments the pc by one for each instruction
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::j_condition(uint8_t cf, uint8_t l, uint8_t h)
+{
+	uint64_t old_cycles {cycles_};
+	if (cf)
+		jmp(l, h);
+	else
+		pc_ += 2;
+	cycles_ = old_cycles + 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::call(uint8_t l, uint8_t h)
+{
+	sp_ -= 2;
+	store(sp_ + 1, static_cast<uint8_t>((pc_+3) >> 8));
+	store(sp_, static_cast<uint8_t>((pc_+3) & 0xff));
+	uint16_t adr {pair(h, l)};
+	pc_ = adr-1;
+	cycles_ += 17;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::c_condition(uint8_t cf, uint8_t l, uint8_t h)
+{
+	if (cf)
+	{
+		call(l, h);
+	}
+	else
+	{
+		pc_ += 2;
+		cycles_ += 11;
+	}
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::ret()
+{
+	uint16_t pcl {static_cast<uint16_t>(bus_.read(sp_))};
+	uint16_t pch = static_cast<uint16_t>(bus_.read(sp_ + 1)) << 8;
+	pc_ = (pch | pcl) - 1;
+	sp_ += 2;
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::r_condition(uint8_t cf)
+{
+	if (cf)
+	{
+		ret();
+		cycles_ += 1;
+	}
+	else
+		cycles_ += 5 ;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::rst(int n)
+{
+	store(sp_ - 1, static_cast<uint8_t>((pc_) >> 8));
+	store(sp_ - 2, static_cast<uint8_t>((pc_) & 0xff));
+	sp_ -= 2;
+	pc_ = 8*n - 1;
+	cycles_ += 11;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::pchl()
+{
+	uint16_t adr {pair(h_, l_)};
+	pc_ = adr-1;
+	cycles_ += 5;
+}
+
+// stack, special, machine io
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::push(uint8_t r1, uint8_t r2)
+{
+	store(sp_ - 1, r1);
+	store(sp_ - 2, r2);
+	sp_ -= 2;
+	cycles_ += 11;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::push_psw()
+{
+	store(sp_ - 1, a_);
+	store(sp_ - 2, psw()); // S-Z-0-AC-0-P-1-CY
+	sp_ -= 2;
+	cycles_ += 11;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::pop(uint8_t &r1, uint8_t &r2)
+{
+	r1 = bus_.read(sp_ + 1);
+	r2 = bus_.read(sp_);
+	sp_ += 2;
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::pop_psw()
+{
+	psw_ = (bus_.read(sp_) & psw_mask) | psw_fixed;
+	lazy_.pending = false;
+	a_ = bus_.read(sp_ + 1);
+	sp_ += 2;
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::xthl()
+{
+	uint8_t tmp {l_};
+	l_ = bus_.read(sp_);
+	store(sp_, tmp);
+	
+	tmp = h_;
+	h_ = bus_.read(sp_ + 1);
+	store(sp_ + 1, tmp);
+	cycles_ += 18;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::sphl()
+{
+	uint16_t d16 {pair(h_, l_)};
+	sp_ = d16;
+	cycles_ += 5;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::in(uint8_t port)
+{
+	a_ = io_.in(port);
+	++pc_;
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::out(uint8_t port)
+{
+	io_.out(port, a_);
+	++pc_;
+	cycles_ += 10;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::ei()
+{
+	int_enabled_ = true;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::di()
+{
+	int_enabled_ = false;
+	cycles_ += 4;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::hlt()
+{
+	halted_ = true;
+	cycles_ += 7;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::nop()
+{
+	cycles_ += 4;
+}
+
+// threaded dispatch
+
+// every opcode and the handler call it decodes to, shared by the computed goto
+// and function pointer versions of the threaded engine
+#define I8080_OPS(X) \
+	X(0x00, nop()) \
+	X(0x01, lxi(b_, c_, opcode[1], opcode[2])) \
+	X(0x02, stax(b_, c_)) \
+	X(0x03, inx(b_, c_)) \
+	X(0x04, inr(b_)) \
+	X(0x05, dcr(b_)) \
+	X(0x06, mvi(b_, opcode[1])) \
+	X(0x07, rlc()) \
+	X(0x08, nop()) \
+	X(0x09, dad(b_, c_)) \
+	X(0x0A, ldax(b_, c_)) \
+	X(0x0B, dcx(b_, c_)) \
+	X(0x0C, inr(c_)) \
+	X(0x0D, dcr(c_)) \
+	X(0x0E, mvi(c_, opcode[1])) \
+	X(0x0F, rrc()) \
+	X(0x10, nop()) \
+	X(0x11, lxi(d_, e_, opcode[1], opcode[2])) \
+	X(0x12, stax(d_, e_)) \
+	X(0x13, inx(d_, e_)) \
+	X(0x14, inr(d_)) \
+	X(0x15, dcr(d_)) \
+	X(0x16, mvi(d_, opcode[1])) \
+	X(0x17, ral()) \
+	X(0x18, nop()) \
+	X(0x19, dad(d_, e_)) \
+	X(0x1A, ldax(d_, e_)) \
+	X(0x1B, dcx(d_, e_)) \
+	X(0x1C, inr(e_)) \
+	X(0x1D, dcr(e_)) \
+	X(0x1E, mvi(e_, opcode[1])) \
+	X(0x1F, rar()) \
+	X(0x20, nop()) \
+	X(0x21, lxi(h_, l_, opcode[1], opcode[2])) \
+	X(0x22, shld(opcode[1], opcode[2])) \
+	X(0x23, inx(h_, l_)) \
+	X(0x24, inr(h_)) \
+	X(0x25, dcr(h_)) \
+	X(0x26, mvi(h_, opcode[1])) \
+	X(0x27, daa()) \
+	X(0x28, nop()) \
+	X(0x29, dad(h_, l_)) \
+	X(0x2A, lhld(opcode[1], opcode[2])) \
+	X(0x2B, dcx(h_, l_)) \
+	X(0x2C, inr(l_)) \
+	X(0x2D, dcr(l_)) \
+	X(0x2E, mvi(l_, opcode[1])) \
+	X(0x2F, cma()) \
+	X(0x30, nop()) \
+	X(0x31, lxi(sp_, opcode[1], opcode[2])) \
+	X(0x32, sta(opcode[1], opcode[2])) \
+	X(0x33, inx(sp_)) \
+	X(0x34, inr_m()) \
+	X(0x35, dcr_m()) \
+	X(0x36, mvi_m(opcode[1])) \
+	X(0x37, stc()) \
+	X(0x38, nop()) \
+	X(0x39, dad(sp_)) \
+	X(0x3A, lda(opcode[1], opcode[2])) \
+	X(0x3B, dcx(sp_)) \
+	X(0x3C, inr(a_)) \
+	X(0x3D, dcr(a_)) \
+	X(0x3E, mvi(a_, opcode[1])) \
+	X(0x3F, cmc()) \
+	X(0x40, mov(b_, b_)) \
+	X(0x41, mov(b_, c_)) \
+	X(0x42, mov(b_, d_)) \
+	X(0x43, mov(b_, e_)) \
+	X(0x44, mov(b_, h_)) \
+	X(0x45, mov(b_, l_)) \
+	X(0x46, mov_r(b_)) \
+	X(0x47, mov(b_, a_)) \
+	X(0x48, mov(c_, b_)) \
+	X(0x49, mov(c_, c_)) \
+	X(0x4A, mov(c_, d_)) \
+	X(0x4B, mov(c_, e_)) \
+	X(0x4C, mov(c_, h_)) \
+	X(0x4D, mov(c_, l_)) \
+	X(0x4E, mov_r(c_)) \
+	X(0x4F, mov(c_, a_)) \
+	X(0x50, mov(d_, b_)) \
+	X(0x51, mov(d_, c_)) \
+	X(0x52, mov(d_, d_)) \
+	X(0x53, mov(d_, e_)) \
+	X(0x54, mov(d_, h_)) \
+	X(0x55, mov(d_, l_)) \
+	X(0x56, mov_r(d_)) \
+	X(0x57, mov(d_, a_)) \
+	X(0x58, mov(e_, b_)) \
+	X(0x59, mov(e_, c_)) \
+	X(0x5A, mov(e_, d_)) \
+	X(0x5B, mov(e_, e_)) \
+	X(0x5C, mov(e_, h_)) \
+	X(0x5D, mov(e_, l_)) \
+	X(0x5E, mov_r(e_)) \
+	X(0x5F, mov(e_, a_)) \
+	X(0x60, mov(h_, b_)) \
+	X(0x61, mov(h_, c_)) \
+	X(0x62, mov(h_, d_)) \
+	X(0x63, mov(h_, e_)) \
+	X(0x64, mov(h_, h_)) \
+	X(0x65, mov(h_, l_)) \
+	X(0x66, mov_r(h_)) \
+	X(0x67, mov(h_, a_)) \
+	X(0x68, mov(l_, b_)) \
+	X(0x69, mov(l_, c_)) \
+	X(0x6A, mov(l_, d_)) \
+	X(0x6B, mov(l_, e_)) \
+	X(0x6C, mov(l_, h_)) \
+	X(0x6D, mov(l_, l_)) \
+	X(0x6E, mov_r(l_)) \
+	X(0x6F, mov(l_, a_)) \
+	X(0x70, mov_m(b_)) \
+	X(0x71, mov_m(c_)) \
+	X(0x72, mov_m(d_)) \
+	X(0x73, mov_m(e_)) \
+	X(0x74, mov_m(h_)) \
+	X(0x75, mov_m(l_)) \
+	X(0x76, hlt()) \
+	X(0x77, mov_m(a_)) \
+	X(0x78, mov(a_, b_)) \
+	X(0x79, mov(a_, c_)) \
+	X(0x7A, mov(a_, d_)) \
+	X(0x7B, mov(a_, e_)) \
+	X(0x7C, mov(a_, h_)) \
+	X(0x7D, mov(a_, l_)) \
+	X(0x7E, mov_r(a_)) \
+	X(0x7F, mov(a_, a_)) \
+	X(0x80, add(b_)) \
+	X(0x81, add(c_)) \
+	X(0x82, add(d_)) \
+	X(0x83, add(e_)) \
+	X(0x84, add(h_)) \
+	X(0x85, add(l_)) \
+	X(0x86, add_m()) \
+	X(0x87, add(a_)) \
+	X(0x88, adc(b_)) \
+	X(0x89, adc(c_)) \
+	X(0x8A, adc(d_)) \
+	X(0x8B, adc(e_)) \
+	X(0x8C, adc(h_)) \
+	X(0x8D, adc(l_)) \
+	X(0x8E, adc_m()) \
+	X(0x8F, adc(a_)) \
+	X(0x90, sub(b_)) \
+	X(0x91, sub(c_)) \
+	X(0x92, sub(d_)) \
+	X(0x93, sub(e_)) \
+	X(0x94, sub(h_)) \
+	X(0x95, sub(l_)) \
+	X(0x96, sub_m()) \
+	X(0x97, sub(a_)) \
+	X(0x98, sbb(b_)) \
+	X(0x99, sbb(c_)) \
+	X(0x9A, sbb(d_)) \
+	X(0x9B, sbb(e_)) \
+	X(0x9C, sbb(h_)) \
+	X(0x9D, sbb(l_)) \
+	X(0x9E, sbb_m()) \
+	X(0x9F, sbb(a_)) \
+	X(0xA0, ana(b_)) \
+	X(0xA1, ana(c_)) \
+	X(0xA2, ana(d_)) \
+	X(0xA3, ana(e_)) \
+	X(0xA4, ana(h_)) \
+	X(0xA5, ana(l_)) \
+	X(0xA6, ana_m()) \
+	X(0xA7, ana(a_)) \
+	X(0xA8, xra(b_)) \
+	X(0xA9, xra(c_)) \
+	X(0xAA, xra(d_)) \
+	X(0xAB, xra(e_)) \
+	X(0xAC, xra(h_)) \
+	X(0xAD, xra(l_)) \
+	X(0xAE, xra_m()) \
+	X(0xAF, xra(a_)) \
+	X(0xB0, ora(b_)) \
+	X(0xB1, ora(c_)) \
+	X(0xB2, ora(d_)) \
+	X(0xB3, ora(e_)) \
+	X(0xB4, ora(h_)) \
+	X(0xB5, ora(l_)) \
+	X(0xB6, ora_m()) \
+	X(0xB7, ora(a_)) \
+	X(0xB8, cmp(b_)) \
+	X(0xB9, cmp(c_)) \
+	X(0xBA, cmp(d_)) \
+	X(0xBB, cmp(e_)) \
+	X(0xBC, cmp(h_)) \
+	X(0xBD, cmp(l_)) \
+	X(0xBE, cmp_m()) \
+	X(0xBF, cmp(a_)) \
+	X(0xC0, r_condition(!zero())) \
+	X(0xC1, pop(b_, c_)) \
+	X(0xC2, j_condition(!zero(), opcode[1], opcode[2])) \
+	X(0xC3, jmp(opcode[1], opcode[2])) \
+	X(0xC4, c_condition(!zero(), opcode[1], opcode[2])) \
+	X(0xC5, push(b_, c_)) \
+	X(0xC6, adi(opcode[1])) \
+	X(0xC7, rst(0)) \
+	X(0xC8, r_condition(zero())) \
+	X(0xC9, ret()) \
+	X(0xCA, j_condition(zero(), opcode[1], opcode[2])) \
+	X(0xCB, nop()) \
+	X(0xCC, c_condition(zero(), opcode[1], opcode[2])) \
+	X(0xCD, call(opcode[1], opcode[2])) \
+	X(0xCE, aci(opcode[1])) \
+	X(0xCF, rst(1)) \
+	X(0xD0, r_condition(!carry())) \
+	X(0xD1, pop(d_, e_)) \
+	X(0xD2, j_condition(!carry(), opcode[1], opcode[2])) \
+	X(0xD3, out(opcode[1])) \
+	X(0xD4, c_condition(!carry(), opcode[1], opcode[2])) \
+	X(0xD5, push(d_, e_)) \
+	X(0xD6, sui(opcode[1])) \
+	X(0xD7, rst(2)) \
+	X(0xD8, r_condition(carry())) \
+	X(0xD9, nop()) \
+	X(0xDA, j_condition(carry(), opcode[1], opcode[2])) \
+	X(0xDB, in(opcode[1])) \
+	X(0xDC, c_condition(carry(), opcode[1], opcode[2])) \
+	X(0xDD, nop()) \
+	X(0xDE, sbi(opcode[1])) \
+	X(0xDF, rst(3)) \
+	X(0xE0, r_condition(!parity_even())) \
+	X(0xE1, pop(h_, l_)) \
+	X(0xE2, j_condition(!parity_even(), opcode[1], opcode[2])) \
+	X(0xE3, xthl()) \
+	X(0xE4, c_condition(!parity_even(), opcode[1], opcode[2])) \
+	X(0xE5, push(h_, l_)) \
+	X(0xE6, ani(opcode[1])) \
+	X(0xE7, rst(4)) \
+	X(0xE8, r_condition(parity_even())) \
+	X(0xE9, pchl()) \
+	X(0xEA, j_condition(parity_even(), opcode[1], opcode[2])) \
+	X(0xEB, xchg()) \
+	X(0xEC, c_condition(parity_even(), opcode[1], opcode[2])) \
+	X(0xED, nop()) \
+	X(0xEE, xri(opcode[1])) \
+	X(0xEF, rst(5)) \
+	X(0xF0, r_condition(!sign())) \
+	X(0xF1, pop_psw()) \
+	X(0xF2, j_condition(!sign(), opcode[1], opcode[2])) \
+	X(0xF3, di()) \
+	X(0xF4, c_condition(!sign(), opcode[1], opcode[2])) \
+	X(0xF5, push_psw()) \
+	X(0xF6, ori(opcode[1])) \
+	X(0xF7, rst(6)) \
+	X(0xF8, r_condition(sign())) \
+	X(0xF9, sphl()) \
+	X(0xFA, j_condition(sign(), opcode[1], opcode[2])) \
+	X(0xFB, ei()) \
+	X(0xFC, c_condition(sign(), opcode[1], opcode[2])) \
+	X(0xFD, nop()) \
+	X(0xFE, cpi(opcode[1])) \
+	X(0xFF, rst(7))
+
+template <class Bus, class Io>
+template <uint8_t Op>
+void Cpu<Bus, Io>::exec([[maybe_unused]] const uint8_t *opcode) // most opcodes have no operand bytes
+{
+	#define X(code, body) if constexpr (Op == code) { body; } else
+	I8080_OPS(X)
+	#undef X
+	{}
+}
+
+template <class Bus, class Io>
+int Cpu<Bus, Io>::threaded(uint64_t deadline)
+{
+	uint8_t fetched[3]; // instructions split across pages are copied here
+	const uint8_t *opcode {nullptr};
+	int last {-1};
+	#ifdef DEBUG
+		#define I8080_COUNT() ++debug_instructions
+	#else
+		#define I8080_COUNT()
+	#endif
+	// pending interrupts are only taken at instruction boundaries
+	#define I8080_FETCH() \
+		opcode = bus_.fetch(pc_, fetched); \
+		if (int_pending_) \
+		{ \
+			opcode = &int_op_; \
+			int_pending_ = false; \
+		} \
+		last = *opcode
+	
+	#ifdef I8080_COMPUTED_GOTO
+		static void *const labels[256]
+		{
+			#define X(code, body) &&op_##code,
+			I8080_OPS(X)
+			#undef X
+		};
+		#define I8080_NEXT() \
+			if (cycles_ >= deadline || halted_) \
+				return last; \
+			I8080_FETCH(); \
+			goto *labels[last]
+		
+		I8080_NEXT();
+		#define X(code, body) \
+			op_##code: \
+				exec<code>(opcode); \
+				I8080_COUNT(); \
+				++pc_; \
+				I8080_NEXT();
+		I8080_OPS(X)
+		#undef X
+		#undef I8080_NEXT
+	#else
+		using Handler = void (Cpu::*)(const uint8_t *);
+		static constexpr Handler handlers[256]
+		{
+			#define X(code, body) &Cpu::exec<code>,
+			I8080_OPS(X)
+			#undef X
+		};
+		while (cycles_ < deadline && !halted_)
+		{
+			I8080_FETCH();
+			(this->*handlers[last])(opcode);
+			I8080_COUNT();
+			++pc_;
+		}
+		return last;
+	#endif
+	#undef I8080_FETCH
+	#undef I8080_COUNT
+}
+
+// block dispatch
+
+template <class Bus, class Io>
+template <uint8_t Op>
+void Cpu<Bus, Io>::run(Cpu &cpu, const uint8_t *opcode)
+{
+	cpu.exec<Op>(opcode);
+}
+
+// Straight-line runs of instructions, decoded once from memory into their
+// handlers and bytes and kept until something writes over them. A block
+// ends at anything that jumps, returns, halts or does IN or OUT (whose
+// handlers may raise an interrupt), so interrupts are still only taken
+// between blocks, at the instruction the interpreters would take them.
+template <class Bus, class Io>
+struct Cpu<Bus, Io>::Block_cache
+{
+	using Handler = void (*)(Cpu &, const uint8_t *);
+
+	struct Op
+	{
+		Handler run;
+		uint8_t bytes[3]; // the opcode and its operands
+		bool stores; // may write memory, and so this very block
+		bool last; // of its block
+		uint16_t cycles; // the most the block can take from here on
+	};
+
+	// a direct-mapped table of recently run blocks in front of index, small
+	// enough to stay in the host's L1 cache
+	struct Recent
+	{
+		uint32_t pc; // or none
+		uint32_t first;
+	};
+
+	static constexpr uint32_t none {0xFFFFFFFF};
+	static constexpr int max_length {32}; // ops per block
+	static constexpr size_t max_ops {1 << 16}; // before starting over
+	static constexpr int recent_size {1024};
+
+	static constexpr Handler handlers[256]
+	{
+		#define X(code, body) &Cpu::run<code>,
+		I8080_OPS(X)
+		#undef X
+	};
+
+	std::vector<uint32_t> index = std::vector<uint32_t>(0x10000, none); // first op of the block at each address
+	std::vector<Op> ops;
+	std::array<Recent, recent_size> recent;
+	std::array<std::vector<uint16_t>, 0x100> starts {}; // blocks on each page
+	uint32_t epoch {0}; // bumped whenever blocks are dropped
+	std::unique_ptr<Jit> jit; // made by the jit's first run
+
+	Block_cache();
+	static constexpr bool ends_block(uint8_t op);
+	static constexpr bool writes(uint8_t op);
+	const Op *find(Cpu &cpu, uint16_t pc);
+	uint32_t decode(Cpu &cpu, uint16_t pc);
+	void drop(int page);
+	void clear();
+};
+
+template <class Bus, class Io>
+Cpu<Bus, Io>::Block_cache::Block_cache()
+{
+	recent.fill({none, 0});
+}
+
+template <class Bus, class Io>
+constexpr bool Cpu<Bus, Io>::Block_cache::ends_block(uint8_t op)
+{
+	switch (op)
+	{
+		case 0x76: // HLT
+		case 0xC3: case 0xC9: case 0xCD: case 0xE9: // JMP, RET, CALL, PCHL
+		case 0xD3: case 0xDB: // OUT, IN
+			return true;
+	}
+	// conditional returns, jumps and calls, and RST
+	int low {op & 0x07};
+	return op >= 0xC0 && (low == 0 || low == 2 || low == 4 || low == 7);
+}
+
+template <class Bus, class Io>
+constexpr bool Cpu<Bus, Io>::Block_cache::writes(uint8_t op)
+{
+	switch (op)
+	{
+		case 0x02: case 0x12: case 0x22: case 0x32: // STAX B, STAX D, SHLD, STA
+		case 0x34: case 0x35: case 0x36: // INR M, DCR M, MVI M
+		case 0xC5: case 0xD5: case 0xE5: case 0xF5: // PUSH
+		case 0xE3: // XTHL
+			return true;
+	}
+	return op >= 0x70 && op <= 0x77 && op != 0x76; // MOV M, r
+}
+
+// the first op of the block at pc
+template <class Bus, class Io>
+auto Cpu<Bus, Io>::Block_cache::find(Cpu &cpu, uint16_t pc) -> const Op *
+{
+	Recent &r {recent[pc % recent_size]};
+	if (r.pc != pc)
+	{
+		uint32_t first {index[pc]};
+		r = {pc, first != none ? first : decode(cpu, pc)};
+	}
+	return &ops[r.first];
+}
+
+template <class Bus, class Io>
+uint32_t Cpu<Bus, Io>::Block_cache::decode(Cpu &cpu, uint16_t pc)
+{
+	if (ops.size() >= max_ops)
+		clear(); // self-modifying code has left too much behind
+	uint32_t first {static_cast<uint32_t>(ops.size())};
+	uint16_t adr {pc};
+	uint8_t op;
+	do
+	{
+		uint8_t fetched[3];
+		const uint8_t *code {cpu.bus_.fetch(adr, fetched)};
+		op = code[0];
+		ops.push_back({handlers[op], {op, code[1], code[2]}, writes(op), false, 0});
+		adr += op_codes[op].second;
+	}
+	while (!ends_block(op) && ops.size() - first < max_length);
+	ops.back().last = true;
+	uint16_t cycles {0};
+	for (size_t i {ops.size()}; i-- > first; )
+		ops[i].cycles = cycles += op_cycles[ops[i].bytes[0]];
+	// list the block under every page it was read from
+	uint8_t last {static_cast<uint8_t>((adr - 1) / 0x100)};
+	for (uint8_t page {static_cast<uint8_t>(pc / 0x100)}; ; ++page)
+	{
+		starts[page].push_back(pc);
+		if (page == last)
+			break;
+	}
+	index[pc] = first;
+	return first;
+}
+
+// forgets the blocks on a page; their ops stay behind until the next clear()
+template <class Bus, class Io>
+void Cpu<Bus, Io>::Block_cache::drop(int page)
+{
+	for (uint16_t start : starts[page])
+	{
+		index[start] = none;
+		if (jit)
+			jit->drop(start);
+	}
+	starts[page].clear();
+	recent.fill({none, 0});
+	++epoch;
+}
+
+template <class Bus, class Io>
+void Cpu<Bus, Io>::Block_cache::clear()
+{
+	std::fill(index.begin(), index.end(), none);
+	ops.clear();
+	recent.fill({none, 0});
+	for (std::vector<uint16_t> &s : starts)
+		s.clear();
+	if (jit)
+		jit->clear();
+	++epoch;
+}
+
+// Runs a block at a time. When the deadline is further off than the most a
+// block can take, its ops run without checking the cycle counter in
+// between; otherwise, and after a write that dropped blocks, the block stops
+// at the same instruction the interpreters would. A pending interrupt runs
+// as a block of its own.
+template <class Bus, class Io>
+int Cpu<Bus, Io>::run_blocks(uint64_t deadline)
+{
+	using Op = typename Block_cache::Op;
+	if (!blocks_)
+		blocks_ = std::make_unique<Block_cache>();
+	Block_cache &cache {*blocks_};
+	Op irq {};
+	const Op *op {nullptr};
+	bool checked {false};
+	uint32_t epoch {0};
+	int last {-1};
+	#ifdef DEBUG
+		#define I8080_COUNT() ++debug_instructions
+	#else
+		#define I8080_COUNT()
+	#endif
+	#define I8080_ENTER() \
+		if (int_pending_) \
+		{ \
+			int_pending_ = false; \
+			irq = {Block_cache::handlers[int_op_], {int_op_}, false, true, 0}; \
+			op = &irq; \
+		} \
+		else \
+			op = cache.find(*this, pc_); \
+		checked = cycles_ + op->cycles > deadline; \
+		epoch = cache.epoch
+	
+	#ifdef I8080_COMPUTED_GOTO
+		static void *const labels[256]
+		{
+			#define X(code, body) &&op_##code,
+			I8080_OPS(X)
+			#undef X
+		};
+		next_block:
+			if (cycles_ >= deadline || halted_)
+				return last;
+			I8080_ENTER();
+			goto *labels[op->bytes[0]];
+		// the rest of the block may have been written over after a drop
+		#define X(code, body) \
+			op_##code: \
+				exec<code>(op->bytes); \
+				I8080_COUNT(); \
+				++pc_; \
+				last = code; \
+				if (op++->last || (checked && cycles_ >= deadline) \
+					|| (Block_cache::writes(code) && cache.epoch != epoch)) \
+					goto next_block; \
+				goto *labels[op->bytes[0]];
+		I8080_OPS(X)
+		#undef X
+	#else
+		while (cycles_ < deadline && !halted_)
+		{
+			I8080_ENTER();
+			do
+			{
+				op->run(*this, op->bytes);
+				I8080_COUNT();
+				++pc_;
+				last = op->bytes[0];
+			}
+			while (!op++->last && !(checked && cycles_ >= deadline)
+				&& !(op[-1].stores && cache.epoch != epoch));
+		}
+		return last;
+	#endif
+	#undef I8080_ENTER
+	#undef I8080_COUNT
+}
+
+// Runs blocks translated by the jit, which chain into each other until one
+// isn't translated yet, a write drops code, or the deadline is near. What
+// the jit can't translate runs here an instruction at a time, interrupts
+// included, and the block engine takes over for the last few blocks before
+// the deadline.
+template <class Bus, class Io>
+void Cpu<Bus, Io>::run_jit(uint64_t deadline)
+{
+	if (!blocks_)
+		blocks_ = std::make_unique<Block_cache>();
+	Block_cache &cache {*blocks_};
+	if (!cache.jit)
+		cache.jit = std::make_unique<Jit>(jit_layout(), &Cpu::jit_read, &Cpu::jit_write);
+	Jit &jit {*cache.jit};
+	if (!jit.ready())
+	{
+		run_blocks(deadline);
+		return;
+	}
+	while (cycles_ < deadline && !halted_)
+	{
+		uint8_t irq[3] {int_op_};
+		const uint8_t *code {irq};
+		if (int_pending_)
+			int_pending_ = false;
+		else
+		{
+			const void *entry {jit.entry(pc_)};
+			if (!entry)
+			{
+				const typename Block_cache::Op *op {cache.find(*this, pc_)};
+				if (!jit.failed(pc_))
+				{
+					uint8_t block[Jit::max_length][3];
+					int n {0};
+					do
+						for (int i {0}; i < 3; ++i)
+							block[n][i] = op[n].bytes[i];
+					while (!op[n++].last);
+					entry = jit.compile(pc_, block, n);
+				}
+				code = op->bytes;
+			}
+			if (entry)
+			{
+				settle_flags(); // translated code keeps them in psw_
+				if (jit.run(this, entry, deadline) == Jit::Exit::deadline)
+				{
+					run_blocks(deadline);
+					return;
+				}
+				continue;
+			}
+		}
+		Block_cache::handlers[code[0]](*this, code);
+		#ifdef DEBUG
+			++debug_instructions;
+		#endif
+		++pc_;
+	}
+}
+
+// where the jit finds the registers
+template <class Bus, class Io>
+Jit_layout Cpu<Bus, Io>::jit_layout() const
+{
+	auto at = [this](const void *field)
+	{
+		return static_cast<int>(static_cast<const char *>(field) - reinterpret_cast<const char *>(this));
+	};
+	return
+	{
+		at(&a_), at(&b_), at(&c_), at(&d_), at(&e_), at(&h_), at(&l_),
+		at(&sp_), at(&pc_), at(&cycles_),
+		at(&psw_),
+		#ifdef DEBUG
+			at(&debug_instructions)
+		#else
+			-1
+		#endif
+	};
+}
+
+template <class Bus, class Io>
+uint8_t Cpu<Bus, Io>::jit_read(void *cpu, uint16_t adr)
+{
+	return static_cast<Cpu *>(cpu)->bus_.read(adr);
+}
+
+template <class Bus, class Io>
+bool Cpu<Bus, Io>::jit_write(void *cpu, uint16_t adr, uint8_t val)
+{
+	Cpu &c {*static_cast<Cpu *>(cpu)};
+	uint32_t epoch {c.blocks_->epoch};
+	c.store(adr, val);
+	return c.blocks_->epoch != epoch;
+}
+
+#undef I8080_OPS
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace i8080
+{
+
+// Port handler policies for Cpu. An Io type provides
+//     uint8_t in(uint8_t port);
+//     void out(uint8_t port, uint8_t val);
+// and is held by value, so a type whose functions are visible where the cpu
+// is instantiated gets them inlined into the dispatch loop.
+
+// type-erased handlers, for when the ports aren't known at compile time
+class Function_io
+{
+	public:
+	Function_io() = default;
+	Function_io(std::function<uint8_t(uint8_t)> in, std::function<void(uint8_t, uint8_t)> out);
+
+	uint8_t in(uint8_t port);
+	void out(uint8_t port, uint8_t val);
+
+	private:
+	std::function<uint8_t(uint8_t)> in_ {};
+	std::function<void(uint8_t, uint8_t)> out_ {};
+};
+
+inline Function_io::Function_io(std::function<uint8_t(uint8_t)> in,
+								std::function<void(uint8_t, uint8_t)> out)
+	: in_(in),
+	  out_(out)
+{}
+
+inline uint8_t Function_io::in(uint8_t port)
+{
+	return in_(port);
+}
+
+inline void Function_io::out(uint8_t port, uint8_t val)
+{
+	out_(port, val);
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace i8080
+{
+
+// where a Cpu keeps its registers, as byte offsets from the Cpu itself
+struct Jit_layout
+{
+	int a, b, c, d, e, h, l;
+	int sp, pc, cycles;
+	int psw; // the flags, as PUSH PSW stores them
+	int instructions; // a counter of instructions to keep up, or -1
+};
+
+// Translates 8080 basic blocks into x86-64 code, the engine behind
+// Dispatch::jit. While translated code runs, HL, BC, DE, A and the cycle
+// counter live in host registers, and blocks jump straight into each other
+// through a table of entries by address. Flags are stored to the Cpu only
+// where something can still read them before they are set again. Memory
+// goes through the reader and writer; everything else (IN, OUT, HLT, EI, DI,
+// DAA, RST, XTHL, pending interrupts, and blocks that could run past the
+// deadline) goes back to the interpreter. The arena is only ever writable or
+// executable, never both, as hardened hosts insist.
+//
+// On other hosts, or where executable memory can't be had, ready() is false
+// and the Cpu runs its block engine instead.
+class Jit
+{
+	public:
+	using Reader = uint8_t (*)(void *cpu, uint16_t adr);
+	using Writer = bool (*)(void *cpu, uint16_t adr, uint8_t val); // true if it dropped code
+
+	// why translated code gave control back
+	enum class Exit
+	{
+		lookup, // the next block isn't translated yet
+		deadline, // the next block could run past the deadline
+		dropped // a write dropped translated code
+	};
+
+	static constexpr int max_length {32}; // instructions per block
+
+	Jit(const Jit_layout &layout, Reader read, Writer write);
+	~Jit();
+	Jit(const Jit &) = delete;
+	Jit &operator=(const Jit &) = delete;
+
+	bool ready() const;
+
+	// the translation of the block at pc, or nullptr
+	const void *entry(uint16_t pc) const;
+	// true if the instruction at pc can't be translated
+	bool failed(uint16_t pc) const;
+	// translates as much of the block at pc as it can, from each
+	// instruction's bytes
+	const void *compile(uint16_t pc, const uint8_t (*code)[3], int count);
+	// runs translated code from entry until it exits, with the Cpu's pc_ at
+	// the next instruction to run
+	Exit run(void *cpu, const void *entry, uint64_t deadline);
+
+	void drop(uint16_t pc);
+	void clear();
+
+	private:
+	friend class Jit_compiler;
+
+	Jit_layout layout_;
+	Reader read_;
+	Writer write_;
+
+	uint8_t *code_ {nullptr}; // the arena translations go in
+	size_t size_ {0};
+	size_t used_ {0};
+	size_t stubs_ {0}; // end of the enter and exit code at the start
+	const void *enter_ {nullptr};
+	const uint8_t *exit_ {nullptr};
+
+	std::vector<const void *> entries_; // by address
+	std::vector<bool> failed_; // by address
+
+	void make_stubs();
+	bool protect(bool writable); // flips the arena between writable and executable
+	void release();
+};
+
+}
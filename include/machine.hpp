@@ -1,37 +1,147 @@
 #pragma once
 
-#include <chrono>
-#include <SDL.h>
+#include <array>
+#include <bitset>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "cpu.hpp"
-#include "audio.hpp"
+#include "scheduler.hpp"
+#include "video.hpp"
 
-#define SCREEN_HEIGHT 256
-#define SCREEN_WIDTH 224
-	
 namespace space_invaders
 {
 
+enum class Button
+{
+	coin,
+	p1_start, p1_shoot, p1_left, p1_right,
+	p2_start, p2_shoot, p2_left, p2_right
+};
+
+// sound effects, in the order of their bits on ports 3 and 5
+enum class Sound
+{
+	ufo, shot, player_die, invader_die,
+	fleet1, fleet2, fleet3, fleet4, ufo_hit
+};
+
+constexpr int sound_count {9};
+
+constexpr uint64_t cpu_clock {2'000'000}; // cycles per second, 2 Mhz
+
+// the values on input ports 1 and 2: everything a cabinet takes in from
+// the player, so a session replays from the inputs of each frame
+struct Inputs
+{
+	uint8_t port1 {0};
+	uint8_t port2 {0};
+};
+
+inline bool operator==(Inputs a, Inputs b)
+{
+	return a.port1 == b.port1 && a.port2 == b.port2;
+}
+
+// where the game keeps its state in ram
+constexpr uint16_t game_mode_adr {0x20EF}; // 1 while a game is on, 0 in attract mode
+constexpr uint16_t p1_score_adr {0x20F8}; // player 1 score, two bytes of BCD, low byte first
+constexpr uint16_t p1_ships_adr {0x21FF}; // player 1 ships in reserve
+
+// front-ends attach to a Machine through these; a cabinet without any sinks
+// runs headless
+class Video_sink
+{
+	public:
+	virtual ~Video_sink() = default;
+	// called once per frame, at the end of the screen, with the columns
+	// written since the previous call
+	virtual void draw(const uint8_t *vram, const Column_mask &dirty) = 0;
+};
+
+class Audio_sink
+{
+	public:
+	virtual ~Audio_sink() = default;
+	// the cpu's cycle counter when the cabinet started or stopped the sound;
+	// sinks that keep to the emulated clock place it by that
+	virtual void play(Sound s, uint64_t cycle) = 0;
+	// for the sounds that last as long as their bit is set, like the ufo's
+	virtual void stop(Sound, uint64_t) {}
+	// a sink that wants a steady clock, like one making its own samples,
+	// asks for tick() that many times per emulated second
+	virtual unsigned tick_rate() const { return 0; }
+	virtual void tick() {}
+};
+
+class Machine;
+
+// the cpu's port handler: calls straight into the Machine, so IN and OUT
+// inline into the dispatch loop instead of going through std::function
+struct Machine_ports
+{
+	Machine *m {nullptr};
+	uint8_t in(uint8_t port);
+	void out(uint8_t port, uint8_t val);
+};
+
+using Machine_cpu = i8080::Cpu<i8080::Paged_bus, Machine_ports>;
 
 class Machine
 {
 	public:
-	Machine();
-	
-	void run();
+	explicit Machine(i8080::Dispatch d = i8080::default_dispatch);
+	Machine(const Machine &) = delete;
+	Machine &operator=(const Machine &) = delete;
+
+	// a copy of this machine that shares its memory pages until either
+	// writes to them; sinks are not carried over
+	std::unique_ptr<Machine> fork();
+
 	bool load_program(const std::string &in, uint16_t off = 0);
-	
+	void attach_video(Video_sink *v);
+	void attach_audio(Audio_sink *a);
+
+	void step_frame();
+	uint64_t frames() const;
+	// step_frame in pieces, for driving the cpu from outside as
+	// Machine_batch does: run the cpu up to next_event(), then
+	// handle_events(), until frames() moves on
+	uint64_t next_event() const;
+	void handle_events();
+
+	// snapshots of the cpu, ram and latches; the rom is left out, so a state
+	// only loads into a Machine running the same program
+	std::vector<uint8_t> save_state() const;
+	void save_state(std::vector<uint8_t> &v) const; // into v, reusing its storage
+	bool load_state(const std::vector<uint8_t> &state);
+
 	uint8_t in(uint8_t port);
 	void out(uint8_t port, uint8_t val);
-	void key_down(SDL_Keycode k);
-	void key_up(SDL_Keycode k);
-	void update_buffer();
-	void update_screen();
-	
+	void press(Button b);
+	void release(Button b);
+	Inputs inputs() const;
+	void set_inputs(Inputs in);
+
+	Machine_cpu &cpu();
+	const uint8_t *vram();
+
 	private:
-	i8080::Cpu cpu_;
-	std::array<uint8_t, 0x10000> memory_;
-	
+	static constexpr int page_size {i8080::Paged_bus::page_size};
+	// rom, ram and the unused rom sockets; everything above mirrors them
+	static constexpr int image_pages {0x6000 / page_size};
+	using Page = std::array<uint8_t, page_size>;
+	struct Fork_tag {};
+
+	Machine(const Machine &parent, Fork_tag);
+
+	Machine_cpu cpu_;
+	std::unique_ptr<uint8_t[]> memory_; // this machine's copy of the address space
+	std::array<std::shared_ptr<const Page>, image_pages> shared_ {}; // pages shared with forks while unchanged
+	std::bitset<image_pages> local_ {}; // pages whose contents are in memory_
+	Column_mask dirty_ {}; // video ram columns written since the last draw
+
 	uint8_t shift0 {0};
 	uint8_t shift1 {0};
 	uint8_t shift_offset {0};
@@ -39,16 +149,29 @@ class Machine
 	uint8_t inp2_ {0};
 	uint8_t sound1_ {0}, last_sound1_ {0};
 	uint8_t sound2_ {0}, last_sound2_ {0};
-	
-	bool done_ {false};
-	std::array<std::array<std::array<uint8_t, 3>, SCREEN_WIDTH>, SCREEN_HEIGHT> screen_buf_ {};
-	SDL_Window *window_;
-	SDL_Surface *disp_;
-	std::array<Wav, 9> sounds_;
-	
-	void execute_cpu(long cyc);
+	uint64_t frames_ {0};
+	Scheduler events_ {};
+	uint64_t audio_ticks_ {0}; // the number of the next audio tick
+
+	Video_sink *video_ {nullptr};
+	Audio_sink *audio_ {nullptr};
+
+	static uint64_t half_frame_end(uint64_t half);
+	void schedule_frame();
+	void schedule_audio();
 	void play_sound();
-	
+	void emit(Sound s);
+	void sound_level(Sound s, bool on);
+	Column_mask dirty_columns();
+	const uint8_t *page(int q) const;
+	void remap(int q);
+	void share(int q);
+	void localize(int q);
+	void own(int q);
+	static void write_ram(void *m, uint16_t adr, uint8_t val);
 };
 
-}
\ No newline at end of file
+}
+
+// compiled in machine.cpp, where the port handlers can inline
+extern template class i8080::Cpu<i8080::Paged_bus, space_invaders::Machine_ports>;
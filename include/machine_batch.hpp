@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "cpu_batch.hpp"
+#include "machine.hpp"
+
+namespace space_invaders
+{
+
+// Steps many cabinets a frame at a time with their cpus in lockstep, see
+// Cpu_batch. Each cabinet ends up exactly where step_frame() would have
+// taken it; the batch pays off when they mostly run the same code, like
+// many agents playing from the same start.
+class Machine_batch
+{
+	public:
+	explicit Machine_batch(std::vector<Machine *> machines);
+
+	void step_frame(); // one frame of every cabinet
+	const i8080::Cpu_batch<i8080::Paged_bus, Machine_ports> &cpus() const;
+
+	private:
+	std::vector<Machine *> machines_;
+	i8080::Cpu_batch<i8080::Paged_bus, Machine_ports> cpus_;
+	std::vector<uint64_t> deadlines_;
+	std::vector<uint64_t> frames_; // the frame each cabinet is on
+};
+
+}
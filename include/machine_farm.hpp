@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "machine.hpp"
+
+namespace space_invaders
+{
+
+// what a farm hands back for each cabinet after a frame, padded to whole
+// cache lines so no two workers write the same line
+struct alignas(64) Observation
+{
+	uint8_t vram[vram_size];
+	uint8_t score[2]; // player 1 score, BCD, low byte first
+	uint8_t lives; // player 1 ships in reserve
+};
+
+// Owns a pool of headless cabinets and steps them all a frame at a time on
+// a set of worker threads. The cabinets are cut into chunks, dealt out to
+// one queue per worker; a worker that runs out of chunks steals from the
+// back of another's queue, so slow chunks don't hold up the frame. The
+// calling thread works as worker 0.
+class Machine_farm
+{
+	public:
+	explicit Machine_farm(size_t cabinets, unsigned threads = std::thread::hardware_concurrency(),
+		i8080::Dispatch d = i8080::default_dispatch);
+	~Machine_farm();
+	Machine_farm(const Machine_farm &) = delete;
+	Machine_farm &operator=(const Machine_farm &) = delete;
+
+	bool load_program(const std::string &in);
+
+	size_t size() const;
+	unsigned threads() const;
+	Machine &machine(size_t i); // to set inputs, save states, ...
+
+	// steps every cabinet one frame; returns the observations, one per
+	// cabinet in one contiguous buffer
+	const Observation *step_frame();
+	const Observation *observations() const;
+
+	private:
+	static constexpr size_t chunk_size {8}; // cabinets per chunk
+
+	struct alignas(64) Queue
+	{
+		std::mutex lock;
+		std::deque<size_t> chunks;
+	};
+
+	std::vector<std::unique_ptr<Machine>> machines_;
+	std::vector<Observation> observations_;
+	std::vector<Queue> queues_;
+	std::vector<std::thread> workers_;
+
+	std::mutex lock_;
+	std::condition_variable start_, done_;
+	uint64_t generation_ {0}; // frames handed out
+	size_t pending_ {0}; // chunks of this frame still running
+	bool stopping_ {false};
+
+	void work(unsigned w);
+	void run_chunks(unsigned w);
+	bool take(unsigned w, size_t &chunk);
+	void run_chunk(size_t chunk);
+};
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "machine.hpp"
+
+namespace space_invaders
+{
+
+// The cabinet's sound effects, mixed in software into one stream of 16-bit
+// mono samples. The WAVs are decoded once, up front, into a single pool at
+// the mixer's rate, and each effect plays straight out of it with one voice
+// of its own, like the cabinet's separate sound circuits: triggering an
+// effect again restarts it. A looping effect (the ufo) wraps around its clip
+// in the pool, down to the sample, until it is stopped. Nothing here touches
+// SDL, so the same mix can go to a sound card or to a file.
+class Mixer
+{
+	public:
+	static constexpr int default_rate {44'100};
+
+	explicit Mixer(int rate = default_rate);
+
+	// loads the effects from dir, by the names the cabinet's samples
+	// usually go by; false if any of them is missing or unreadable
+	bool load_sounds(const std::string &dir = "audio");
+	// 8 or 16-bit PCM, in any rate and number of channels; replaces what
+	// was loaded for s before
+	bool load(Sound s, const std::string &path);
+
+	int rate() const;
+	void set_loop(Sound s, bool loop);
+	void play(Sound s);
+	void stop(Sound s);
+	void mix(int16_t *out, size_t n); // the next n samples
+
+	private:
+	struct Clip
+	{
+		size_t start {0}; // in the pool
+		size_t length {0};
+		bool loop {false};
+	};
+
+	struct Voice
+	{
+		size_t pos {0}; // into the clip
+		bool playing {false};
+	};
+
+	int rate_;
+	std::vector<int16_t> pool_;
+	std::array<Clip, sound_count> clips_ {};
+	std::array<Voice, sound_count> voices_ {};
+	std::array<int32_t, 256> sum_ {}; // a chunk of the mix before clipping
+};
+
+// An Audio_sink that starts and stops the effects in a Mixer at the sample
+// the cycle of each event falls on, and passes the mix on as it goes. The
+// samples follow the emulated clock rather than the wall clock, so a session
+// sounds the same however fast it runs, down to the sample. When a loaded
+// state moves the clock back, as rewinding does, the stream picks up from
+// there without a gap.
+class Audio_stream : public Audio_sink
+{
+	public:
+	using Output = std::function<void(const int16_t *samples, size_t n)>;
+
+	Audio_stream(Mixer &mixer, Output out);
+
+	void play(Sound s, uint64_t cycle) override;
+	void stop(Sound s, uint64_t cycle) override;
+	// mixes up to cycle; call it after each frame, and at the end
+	void advance(uint64_t cycle);
+	uint64_t samples() const; // passed on so far
+
+	private:
+	Mixer &mixer_;
+	Output out_;
+	uint64_t base_cycle_ {0}; // the cycle sample base_sample_ starts at
+	uint64_t base_sample_ {0};
+	uint64_t mixed_ {0};
+	std::array<int16_t, 1024> buf_ {};
+};
+
+// writes 16-bit mono PCM to a WAV file as it comes, and fills in the sizes
+// in its header when closed
+class Wav_writer
+{
+	public:
+	Wav_writer(const std::string &path, int rate);
+	~Wav_writer();
+	Wav_writer(const Wav_writer &) = delete;
+	Wav_writer &operator=(const Wav_writer &) = delete;
+
+	bool good() const;
+	void write(const int16_t *samples, size_t n);
+	bool close();
+
+	private:
+	std::ofstream f_;
+	int rate_;
+	uint64_t samples_ {0};
+
+	void header();
+};
+
+}
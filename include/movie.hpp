@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "machine.hpp"
+
+namespace space_invaders
+{
+
+// A recorded session: the inputs of every frame since power-on, and a hash
+// of the state it ended in. The cabinet only reads its inputs between
+// frames and runs the same from the same inputs, so playing the inputs
+// back into a fresh Machine with the same rom reproduces the session.
+class Movie
+{
+	public:
+	// call before each step_frame; recording at an earlier frame than the
+	// last (after a rewind) drops the frames that came after it
+	void record(const Machine &m);
+	void finish(const Machine &m); // marks the end and the state it ended in
+
+	// steps m through the movie from power-on; true if it ends in the
+	// recorded state
+	bool play(Machine &m) const;
+
+	uint64_t frames() const;
+	uint64_t end_hash() const;
+
+	// the inputs are stored as runs, which keeps hours of play to a few
+	// kilobytes
+	bool save(const std::string &path) const;
+	bool load(const std::string &path);
+
+	private:
+	std::vector<Inputs> inputs_;
+	uint64_t end_hash_ {0};
+};
+
+// FNV-1a of the save state
+uint64_t hash_state(const Machine &m);
+
+}
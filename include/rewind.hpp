@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "machine.hpp"
+
+namespace space_invaders
+{
+
+// Records the states of a Machine into a ring buffer of fixed size to step
+// back through them. Each entry is the save state XORed with the one
+// recorded before it, so it only costs the bytes that changed in between;
+// the newest state is kept whole, and stepping back undoes the newest
+// entry. No entry depends on an older one, so when the ring is full the
+// oldest simply goes.
+class Rewind
+{
+	public:
+	explicit Rewind(size_t capacity = 64 << 20, int interval = 1);
+
+	void record(const Machine &m); // call once per frame; keeps every interval-th
+	bool step_back(Machine &m); // false once there is nothing older
+	void clear();
+
+	size_t entries() const;
+	size_t bytes() const; // encoded bytes in the ring
+
+	private:
+	struct Entry
+	{
+		uint64_t frame;
+		size_t offset, size;
+	};
+
+	std::vector<uint8_t> ring_;
+	std::deque<Entry> entries_;
+	size_t head_ {0}; // where the next entry goes
+	int interval_;
+	std::vector<uint8_t> newest_; // state of the newest entry
+	std::vector<uint8_t> state_; // the state being recorded
+	std::vector<uint8_t> scratch_; // encoder output
+
+	void push(uint64_t frame, size_t size);
+	void undo(const Entry &e);
+};
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace space_invaders
+{
+
+// things that happen at set points on the cpu's cycle counter
+enum class Event
+{
+	mid_screen, // RST 1, as the beam passes the middle of the screen
+	end_screen, // the frame is drawn, then RST 2
+	audio_tick, // a sample for an audio sink that asked for them
+	count
+};
+
+// Events stamped with the cycle they are due at, at most one of each kind
+// pending. The cpu runs straight to next(), so its dispatch loop only ever
+// checks one deadline, and whatever is due then gets handled in order. A
+// peripheral with timing of its own adds a kind of event.
+class Scheduler
+{
+	public:
+	static constexpr uint64_t never {std::numeric_limits<uint64_t>::max()};
+
+	Scheduler();
+
+	void schedule(Event e, uint64_t cycle);
+	void cancel(Event e);
+	uint64_t next() const; // the cycle the earliest event is due at
+	uint64_t due(Event e) const; // never if it isn't pending
+	bool pop(uint64_t cycle, Event &e); // the earliest event due by cycle
+
+	private:
+	static constexpr int event_count {static_cast<int>(Event::count)};
+
+	std::array<uint64_t, event_count> due_;
+	uint64_t next_ {never};
+
+	void update();
+};
+
+// defined here, so the frame loop can inline them
+
+inline Scheduler::Scheduler()
+{
+	due_.fill(never);
+}
+
+inline void Scheduler::schedule(Event e, uint64_t cycle)
+{
+	due_[static_cast<int>(e)] = cycle;
+	update();
+}
+
+inline void Scheduler::cancel(Event e)
+{
+	schedule(e, never);
+}
+
+inline uint64_t Scheduler::next() const
+{
+	return next_;
+}
+
+inline uint64_t Scheduler::due(Event e) const
+{
+	return due_[static_cast<int>(e)];
+}
+
+// ties go to the event listed first
+inline bool Scheduler::pop(uint64_t cycle, Event &e)
+{
+	if (next_ > cycle)
+		return false;
+	int first {0};
+	for (int i {1}; i < event_count; ++i)
+		if (due_[i] < due_[first])
+			first = i;
+	e = static_cast<Event>(first);
+	cancel(e);
+	return true;
+}
+
+inline void Scheduler::update()
+{
+	next_ = never;
+	for (uint64_t cycle : due_)
+		if (cycle < next_)
+			next_ = cycle;
+}
+
+}
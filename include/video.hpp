@@ -0,0 +1,66 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define SCREEN_HEIGHT 256
+#define SCREEN_WIDTH 224
+
+namespace space_invaders
+{
+
+// video ram holds the screen rotated 90 degrees: each of the 224 columns is
+// 32 bytes running from the bottom of the screen to the top, lsb first
+constexpr uint16_t vram_start {0x2400};
+constexpr int vram_size {SCREEN_WIDTH * SCREEN_HEIGHT / 8};
+
+// one bit per screen column, set for the columns whose video ram changed
+using Column_mask = std::bitset<SCREEN_WIDTH>;
+
+// implementations of the 1bpp to 32-bit conversion
+enum class Expander
+{
+	scalar,
+	sse2,
+	avx2
+};
+
+bool supported(Expander e);
+Expander best_expander(); // picked from the host cpu at startup
+
+// expands 1bpp video ram into upright 32-bit pixels, SCREEN_WIDTH per row
+void expand_frame(const uint8_t *vram, uint32_t *pix);
+void expand_frame(const uint8_t *vram, uint32_t *pix, Expander e);
+// same, but only touches the 8-column tiles holding a dirty column
+void expand_columns(const uint8_t *vram, uint32_t *pix, const Column_mask &dirty);
+void expand_columns(const uint8_t *vram, uint32_t *pix, const Column_mask &dirty, Expander e);
+
+// scales upright pixels up by a whole factor, nearest neighbour, into rows
+// pitch pixels apart; 2, 3 and 4 have loops of their own
+void scale_frame(const uint32_t *pix, uint32_t *dst, int pitch, int scale);
+
+// Writes upright 32-bit frames, as the expanders make them, to an
+// uncompressed YUV4MPEG2 file at 60 frames per second, which ffmpeg and
+// most players read as is. Each frame goes out in one write, through a
+// stream buffer of a few frames.
+class Y4m_writer
+{
+	public:
+	explicit Y4m_writer(const std::string &path);
+	Y4m_writer(const Y4m_writer &) = delete;
+	Y4m_writer &operator=(const Y4m_writer &) = delete;
+
+	bool good() const;
+	void write(const uint32_t *pix);
+	bool close(); // true if everything made it to the file
+
+	private:
+	std::vector<char> buffer_;
+	std::ofstream f_;
+	std::vector<uint8_t> frame_; // the frame as 4:2:0 planes
+};
+
+}
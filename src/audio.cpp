@@ -1,33 +1,63 @@
 #include "audio.hpp"
-#include <SDL.h>
 
-Wav::Wav(const std::string &s)
-	: spec_ {}, buf_ {nullptr}, len_ {0}
+#include <algorithm>
+
+namespace space_invaders
+{
+
+// asks for the mixer's own format, SDL converts if the hardware differs; the
+// device stays paused until the first samples are queued
+Audio_device::Audio_device(int rate)
+	: ring_(rate / 10)
 {
-	std::string path {s + ".wav"};
-	auto success {SDL_LoadWAV(path.c_str(), &spec_, &buf_, &len_)};
-	if (success == NULL)
-		SDL_Log("Failed to load WAV: %s", path.c_str(), SDL_GetError());
-	SDL_AudioSpec obtained; // format obtained
-	dev_ = SDL_OpenAudioDevice(nullptr, 0, &spec_, &obtained, 0);
+	SDL_AudioSpec want {};
+	want.freq = rate;
+	want.format = AUDIO_S16SYS;
+	want.channels = 1;
+	want.samples = 512; // about 12 ms at 44.1 kHz
+	want.callback = fill;
+	want.userdata = this;
+	SDL_AudioSpec obtained;
+	dev_ = SDL_OpenAudioDevice(nullptr, 0, &want, &obtained, 0);
 	if (dev_ == 0)
 		SDL_Log("Failed to open audio: %s", SDL_GetError());
 }
 
-Wav::~Wav()
+Audio_device::~Audio_device()
+{
+	if (dev_)
+		SDL_CloseAudioDevice(dev_);
+}
+
+bool Audio_device::ready() const
 {
-	SDL_CloseAudioDevice(dev_);
-	SDL_FreeWAV(buf_);
+	return dev_ != 0;
 }
 
-bool Wav::play()
+void Audio_device::queue(const int16_t *samples, size_t n)
 {
-	int success {SDL_QueueAudio(dev_, buf_, len_)};
+	if (!dev_)
+		return;
+	SDL_LockAudioDevice(dev_);
+	n = std::min(n, ring_.size() - size_);
+	for (size_t i {0}; i < n; ++i)
+		ring_[(head_ + size_ + i) % ring_.size()] = samples[i];
+	size_ += n;
+	SDL_UnlockAudioDevice(dev_);
 	SDL_PauseAudioDevice(dev_, 0);
-	return success;
 }
 
-void Wav::loop()
+void Audio_device::fill(void *device, Uint8 *stream, int len)
 {
-	
+	Audio_device &self {*static_cast<Audio_device *>(device)};
+	int16_t *out {reinterpret_cast<int16_t *>(stream)};
+	size_t n {len / sizeof(int16_t)};
+	size_t count {std::min(n, self.size_)};
+	for (size_t i {0}; i < count; ++i)
+		out[i] = self.ring_[(self.head_ + i) % self.ring_.size()];
+	std::fill(out + count, out + n, 0);
+	self.head_ = (self.head_ + count) % self.ring_.size();
+	self.size_ -= count;
+}
+
 }
@@ -0,0 +1,93 @@
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "machine_batch.hpp"
+
+// Steps cabinets as a Machine_batch beside the same cabinets stepped one by
+// one, and checks every frame that each lane's state matches its twin's.
+// The lanes play with inputs of their own, and half of them start some
+// frames ahead, so they spread over the program and the batch has to split
+// and merge its lanes.
+
+namespace
+{
+
+using space_invaders::Button;
+using space_invaders::Machine;
+
+constexpr int lanes {16};
+constexpr long frames {3000};
+
+// a coin and a game for one player, then moving and firing to a rhythm of
+// the lane's own
+void play(Machine &m, int lane, long frame)
+{
+	auto set = [&m](Button b, bool on)
+	{
+		if (on)
+			m.press(b);
+		else
+			m.release(b);
+	};
+	long t {frame + 13 * lane};
+	set(Button::coin, frame % 1500 >= 100 + lane % 7 && frame % 1500 < 110 + lane % 7);
+	set(Button::p1_start, frame % 1500 >= 200 && frame % 1500 < 210);
+	set(Button::p1_shoot, frame > 300 && t % (17 + lane) < 3);
+	set(Button::p1_left, frame > 300 && t / (40 + lane) % 2);
+	set(Button::p1_right, frame > 300 && !(t / (40 + lane) % 2));
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	std::string rom {argc > 1 ? argv[1] : "invaders.rom"};
+	if (!std::ifstream(rom).good())
+	{
+		std::cout << "no " << rom << ", skipping\n";
+		return 0;
+	}
+	std::vector<std::unique_ptr<Machine>> batched, separate;
+	std::vector<Machine *> machines;
+	for (int i {0}; i < lanes; ++i)
+	{
+		for (auto *v : {&batched, &separate})
+		{
+			v->push_back(std::make_unique<Machine>());
+			v->back()->load_program(rom);
+			for (int f {0}; f < (i % 2 ? 37 * i : 0); ++f) // a head start
+				v->back()->step_frame();
+		}
+		machines.push_back(batched.back().get());
+	}
+	space_invaders::Machine_batch batch {machines};
+	long bad {0};
+	for (long f {0}; f < frames; ++f)
+	{
+		for (int i {0}; i < lanes; ++i)
+		{
+			play(*batched[i], i, f);
+			play(*separate[i], i, f);
+		}
+		batch.step_frame();
+		for (int i {0}; i < lanes; ++i)
+		{
+			separate[i]->step_frame();
+			if (batched[i]->save_state() != separate[i]->save_state())
+			{
+				if (!bad)
+					std::cout << "lane " << i << " differs at frame " << f << '\n';
+				++bad;
+			}
+		}
+	}
+	const auto &cpus = batch.cpus();
+	uint64_t all {cpus.lockstep_instructions + cpus.scalar_instructions};
+	std::cout << lanes << " lanes, " << frames << " frames: " << bad << " lane frames differ, "
+		<< 100 * cpus.lockstep_instructions / (all ? all : 1) << "% of instructions in lockstep\n";
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,433 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "env.hpp"
+#include "machine.hpp"
+#include "machine_batch.hpp"
+#include "machine_farm.hpp"
+#include "mixer.hpp"
+#include "rewind.hpp"
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+std::string rom;
+
+double seconds_since(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(const std::string &name, double rate, const std::string &unit)
+{
+	std::cout << std::left << std::setw(24) << name << std::right
+		<< std::fixed << std::setprecision(1) << std::setw(12)
+		<< rate << ' ' << unit << '\n';
+}
+
+// Instructions are counted outside the timed runs, so the engines run as
+// they ship, without DEBUG's counter: every engine runs the same
+// instructions (engine_test checks), so one run an instruction at a time
+// on the switch counts them for all.
+template <class Cpu>
+uint64_t run_counted(Cpu &cpu, uint64_t deadline)
+{
+	uint64_t n {0};
+	while (cpu.cycles() < deadline)
+		if (cpu.state().halted)
+			cpu.run_until(deadline);
+		else
+		{
+			cpu.emulate_op();
+			++n;
+		}
+	return n;
+}
+
+// the instructions in the first frames of attract mode, stepped in pieces
+uint64_t attract_instructions(long frames)
+{
+	space_invaders::Machine m {i8080::Dispatch::switch_case};
+	m.load_program(rom);
+	uint64_t n {0};
+	while (m.frames() < static_cast<uint64_t>(frames))
+	{
+		n += run_counted(m.cpu(), m.next_event());
+		m.handle_events();
+	}
+	return n;
+}
+
+// runs a headless cabinet in attract mode, frames back to back
+void bench_dispatch(i8080::Dispatch d, const std::string &name, long frames, uint64_t instructions)
+{
+	space_invaders::Machine m {d};
+	m.load_program(rom);
+	auto start = Clock::now();
+	for (long i {0}; i < frames; ++i)
+		m.step_frame();
+	double secs {seconds_since(start)};
+	report(name, instructions / secs / 1e6, "M instructions/s");
+	report("", frames / secs, "frames/s");
+}
+
+// runs a cpu on a cabinet's bus through its interrupts, a frame at a time,
+// the way Machine::step_frame does
+template <class Cpu>
+void run_frames(Cpu &cpu, long frames)
+{
+	constexpr uint64_t half_frame {space_invaders::cpu_clock / 120};
+	uint64_t half {cpu.cycles() / half_frame};
+	for (long i {0}; i < 2 * frames; ++i)
+	{
+		++half;
+		cpu.run_until(half * half_frame);
+		cpu.interrupt(half % 2 ? 0xCF : 0xD7);
+	}
+}
+
+// the cabinet's own cpu in attract mode, with IN and OUT going to
+// Machine::in and Machine::out through Machine_ports, where they inline, or
+// through std::function
+void bench_ports(bool inlined, const std::string &name, long frames)
+{
+	space_invaders::Machine m {i8080::Dispatch::threaded};
+	m.load_program(rom);
+	i8080::Cpu<i8080::Paged_bus> wrapped
+	{
+		m.cpu().bus(),
+		i8080::Function_io
+		{
+			[&m](uint8_t port) { return m.in(port); },
+			[&m](uint8_t port, uint8_t val) { m.out(port, val); }
+		},
+		i8080::Dispatch::threaded
+	};
+	auto start = Clock::now();
+	if (inlined)
+		run_frames(m.cpu(), frames);
+	else
+		run_frames(wrapped, frames);
+	report(name, frames / seconds_since(start), "frames/s");
+}
+
+// for loops that never touch a port; visible here, so the cpu running them
+// gets instantiated and optimized in this file
+struct No_ports
+{
+	uint8_t in(uint8_t)
+	{
+		return 0;
+	}
+
+	void out(uint8_t, uint8_t)
+	{
+	}
+};
+
+// a loop of ALU instructions whose flags only the branch at its end reads:
+// ADD B, XRA C, ANA D, ORA E, SUB B, CMP C, INR A, DCR B, JNZ 0, DCR C, JMP 0
+const std::array<uint8_t, 0x10000> alu_loop {0x80, 0xA9, 0xA2, 0xB3, 0x90, 0xB9, 0x3C, 0x05, 0xC2, 0x00, 0x00,
+	0x0D, 0xC3, 0x00, 0x00};
+
+uint64_t alu_instructions(uint64_t cycles)
+{
+	std::array<uint8_t, 0x10000> mem {alu_loop};
+	i8080::Cpu<i8080::Flat_bus, No_ports> cpu {mem, No_ports {}, i8080::Dispatch::switch_case};
+	return run_counted(cpu, cycles);
+}
+
+void bench_alu(i8080::Dispatch d, const std::string &name, uint64_t cycles, uint64_t instructions)
+{
+	std::array<uint8_t, 0x10000> mem {alu_loop};
+	i8080::Cpu<i8080::Flat_bus, No_ports> cpu {mem, No_ports {}, d};
+	auto start = Clock::now();
+	cpu.run_until(cycles);
+	report(name, instructions / seconds_since(start) / 1e6, "M instructions/s");
+}
+
+// saves and restores the state of a cabinet in the middle of its attract mode
+void bench_states(const std::string &name, long states)
+{
+	space_invaders::Machine m {};
+	m.load_program(rom);
+	for (int i {0}; i < 600; ++i)
+		m.step_frame();
+	auto start = Clock::now();
+	for (long i {0}; i < states; ++i)
+		m.load_state(m.save_state());
+	report(name, states / seconds_since(start) / 1e3, "k states/s");
+}
+
+// forks a cabinet in the middle of its attract mode, and runs each child
+// for a frame so it copies the pages it writes
+void bench_forks(const std::string &name, long forks)
+{
+	space_invaders::Machine m {};
+	m.load_program(rom);
+	for (int i {0}; i < 600; ++i)
+		m.step_frame();
+	auto start = Clock::now();
+	for (long i {0}; i < forks; ++i)
+		m.fork()->step_frame();
+	report(name, forks / seconds_since(start) / 1e3, "k forks/s");
+}
+
+// records every frame of the attract mode into a rewind buffer, timing only
+// the recording
+void bench_rewind(const std::string &name, long frames)
+{
+	space_invaders::Machine m {};
+	m.load_program(rom);
+	space_invaders::Rewind r {};
+	double secs {0};
+	for (long i {0}; i < frames; ++i)
+	{
+		m.step_frame();
+		auto start = Clock::now();
+		r.record(m);
+		secs += seconds_since(start);
+	}
+	report(name, secs / frames * 1e6, "us/frame");
+	report("", static_cast<double>(r.bytes()) / r.entries(), "bytes/frame");
+}
+
+// runs n cabinets in attract mode one after the other or as a batch;
+// staggered cabinets start a frame apart, so they are never at the same
+// point of the program
+void bench_batch(bool batched, bool staggered, const std::string &name, int n, long frames)
+{
+	std::vector<std::unique_ptr<space_invaders::Machine>> cabinets;
+	std::vector<space_invaders::Machine *> lanes;
+	for (int i {0}; i < n; ++i)
+	{
+		cabinets.push_back(std::make_unique<space_invaders::Machine>());
+		cabinets.back()->load_program(rom);
+		for (int k {0}; staggered && k < i; ++k)
+			cabinets.back()->step_frame();
+		lanes.push_back(cabinets.back().get());
+	}
+	space_invaders::Machine_batch batch {lanes};
+	auto start = Clock::now();
+	for (long i {0}; i < frames; ++i)
+	{
+		if (batched)
+			batch.step_frame();
+		else
+			for (space_invaders::Machine *m : lanes)
+				m->step_frame();
+	}
+	report(name, n * frames / seconds_since(start) / 1e3, "k frames/s");
+}
+
+// steps a farm of cabinets in attract mode, observations included
+void bench_farm(unsigned threads, const std::string &name, size_t cabinets, long frames)
+{
+	space_invaders::Machine_farm farm {cabinets, threads};
+	farm.load_program(rom);
+	auto start = Clock::now();
+	for (long i {0}; i < frames; ++i)
+		farm.step_frame();
+	report(name, cabinets * frames / seconds_since(start) / 1e3, "k frames/s");
+}
+
+enum class Obs
+{
+	view, downsampled, expanded
+};
+
+// steps an Env through games with a fixed cycle of actions, reading every
+// observation in place, shrunk by 4, or expanded to 32-bit pixels the way
+// the window draws them
+void bench_env(Obs obs, const std::string &name, long steps)
+{
+	space_invaders::Env env {4};
+	if (!env.load_program(rom) || !env.reset())
+	{
+		std::cout << std::left << std::setw(24) << name << " no game started\n";
+		return;
+	}
+	std::vector<uint32_t> pix(SCREEN_WIDTH * SCREEN_HEIGHT);
+	long lit {0};
+	auto start = Clock::now();
+	for (long i {0}; i < steps; ++i)
+	{
+		if (env.step(static_cast<space_invaders::Action>(i % space_invaders::action_count)).done)
+			env.reset();
+		if (obs == Obs::view)
+			lit += env.observation()[i % space_invaders::vram_size];
+		else if (obs == Obs::downsampled)
+			lit += env.downsampled(4)[0];
+		else
+		{
+			space_invaders::expand_frame(env.observation().data, pix.data());
+			lit += pix[0];
+		}
+	}
+	report(name, steps / seconds_since(start) / 1e3, "k steps/s");
+	if (lit < 0)
+		std::cout << lit; // keeps the reads
+}
+
+// converts the screen of a cabinet that has been through its attract mode
+void bench_expander(space_invaders::Expander e, const std::string &name, long frames)
+{
+	if (!space_invaders::supported(e))
+	{
+		std::cout << std::left << std::setw(24) << name << " not supported\n";
+		return;
+	}
+	space_invaders::Machine m {};
+	m.load_program(rom);
+	for (int i {0}; i < 600; ++i)
+		m.step_frame();
+	alignas(64) static uint32_t pix[SCREEN_WIDTH * SCREEN_HEIGHT];
+	auto start = Clock::now();
+	for (long i {0}; i < frames; ++i)
+		space_invaders::expand_frame(m.vram(), pix, e);
+	report(name, frames / seconds_since(start), "frames/s");
+}
+
+// scales the screen of a cabinet that has been through its attract mode, the
+// way the window does without an accelerated renderer
+void bench_scaler(int scale, const std::string &name, long frames)
+{
+	space_invaders::Machine m {};
+	m.load_program(rom);
+	for (int i {0}; i < 600; ++i)
+		m.step_frame();
+	static uint32_t pix[SCREEN_WIDTH * SCREEN_HEIGHT];
+	space_invaders::expand_frame(m.vram(), pix);
+	std::vector<uint32_t> window(scale * SCREEN_WIDTH * scale * SCREEN_HEIGHT);
+	auto start = Clock::now();
+	for (long i {0}; i < frames; ++i)
+		space_invaders::scale_frame(pix, window.data(), scale * SCREEN_WIDTH, scale);
+	report(name, frames / seconds_since(start), "frames/s");
+}
+
+// a headless renderer that converts every frame, in full or dirty columns only
+class Bench_sink : public space_invaders::Video_sink
+{
+	public:
+	explicit Bench_sink(bool full) : full_ {full} {}
+	
+	void draw(const uint8_t *vram, const space_invaders::Column_mask &dirty) override
+	{
+		if (full_)
+			space_invaders::expand_frame(vram, pix_);
+		else
+			space_invaders::expand_columns(vram, pix_, dirty);
+		columns += dirty.count();
+	}
+	
+	long columns {0};
+	
+	private:
+	bool full_;
+	alignas(64) uint32_t pix_[SCREEN_WIDTH * SCREEN_HEIGHT] {};
+};
+
+void bench_render(bool full, const std::string &name, long frames)
+{
+	space_invaders::Machine m {};
+	Bench_sink sink {full};
+	m.attach_video(&sink);
+	m.load_program(rom);
+	auto start = Clock::now();
+	for (long i {0}; i < frames; ++i)
+		m.step_frame();
+	report(name, frames / seconds_since(start), "frames/s");
+	if (!full)
+		report("", static_cast<double>(sink.columns) / frames, "dirty columns/frame");
+}
+
+// mixes sound in the chunks a sound card asks for, restarting every effect
+// about once a frame
+void bench_mixer(const std::string &name, long seconds)
+{
+	space_invaders::Mixer mixer {};
+	if (!mixer.load_sounds())
+	{
+		std::cout << std::left << std::setw(24) << name << " no sounds in audio/\n";
+		return;
+	}
+	constexpr int chunk {512};
+	std::array<int16_t, chunk> out;
+	long samples {0};
+	auto start = Clock::now();
+	for (long i {0}; i < seconds * mixer.rate() / chunk; ++i)
+	{
+		if (i % (mixer.rate() / 60 / chunk + 1) == 0)
+			for (int s {0}; s < space_invaders::sound_count; ++s)
+				mixer.play(static_cast<space_invaders::Sound>(s));
+		mixer.mix(out.data(), chunk);
+		samples += chunk;
+	}
+	report(name, samples / seconds_since(start) / 1e6, "M samples/s");
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	rom = argc > 1 ? argv[1] : "invaders.rom";
+	if (!std::ifstream(rom).good())
+	{
+		std::cerr << "Could not open " << rom << '\n';
+		return 1;
+	}
+	constexpr long frames {20'000};
+	// each engine on the game in attract mode, then on nothing but ALU
+	// instructions and the flags they set
+	const std::pair<i8080::Dispatch, std::string> engines[]
+	{
+		{i8080::Dispatch::switch_case, "switch"},
+		{i8080::Dispatch::threaded, "threaded"},
+		{i8080::Dispatch::block, "block cache"},
+		{i8080::Dispatch::jit, "jit"}
+	};
+	uint64_t attract {attract_instructions(frames)};
+	for (const auto &[d, name] : engines)
+		bench_dispatch(d, "dispatch: " + name, frames, attract);
+	constexpr uint64_t alu_cycles {400'000'000};
+	uint64_t alu {alu_instructions(alu_cycles)};
+	for (const auto &[d, name] : engines)
+		bench_alu(d, "alu loop: " + name, alu_cycles, alu);
+	bench_ports(false, "ports: std::function", frames);
+	bench_ports(true, "ports: Machine_ports", frames);
+	bench_states("save + load state", 200'000);
+	bench_forks("fork + 1 frame", 20'000);
+	bench_rewind("rewind: record", frames);
+	bench_batch(false, false, "256 cabinets: separate", 256, 200);
+	bench_batch(true, false, "256 cabinets: batch", 256, 200);
+	bench_batch(false, true, "staggered: separate", 256, 200);
+	bench_batch(true, true, "staggered: batch", 256, 200);
+	bench_env(Obs::view, "env: video ram view", 20'000);
+	bench_env(Obs::downsampled, "env: downsampled by 4", 20'000);
+	bench_env(Obs::expanded, "env: expanded to rgb", 20'000);
+	unsigned cores {std::max(std::thread::hardware_concurrency(), 1u)};
+	for (unsigned threads {1}; threads < cores; threads *= 2)
+		bench_farm(threads, "farm: " + std::to_string(threads) + " threads", 1024, 50);
+	bench_farm(cores, "farm: " + std::to_string(cores) + " threads", 1024, 50);
+	bench_expander(space_invaders::Expander::scalar, "expand_frame: scalar", frames);
+	bench_expander(space_invaders::Expander::sse2, "expand_frame: sse2", frames);
+	bench_expander(space_invaders::Expander::avx2, "expand_frame: avx2", frames);
+	bench_render(true, "render: full frames", frames);
+	bench_render(false, "render: dirty columns", frames);
+	bench_scaler(2, "scale_frame: 2x", frames);
+	bench_scaler(3, "scale_frame: 3x", frames);
+	bench_scaler(4, "scale_frame: 4x", frames);
+	bench_mixer("mixer: 9 voices", 600);
+	return 0;
+}
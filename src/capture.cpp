@@ -0,0 +1,126 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "machine.hpp"
+#include "mixer.hpp"
+#include "movie.hpp"
+
+namespace
+{
+
+// takes each frame the cabinet draws, through the same conversion as the
+// window, and brings the sound up to the end of it
+class Capture : public space_invaders::Video_sink
+{
+	public:
+	Capture(space_invaders::Machine &m, space_invaders::Y4m_writer *video, space_invaders::Audio_stream *audio)
+		: m_ {m}, video_ {video}, audio_ {audio} {}
+
+	void draw(const uint8_t *vram, const space_invaders::Column_mask &dirty) override
+	{
+		if (video_)
+		{
+			space_invaders::expand_columns(vram, pix_, dirty);
+			video_->write(pix_);
+		}
+		if (audio_)
+			audio_->advance(m_.cpu().cycles());
+	}
+
+	private:
+	space_invaders::Machine &m_;
+	space_invaders::Y4m_writer *video_;
+	space_invaders::Audio_stream *audio_;
+	alignas(64) uint32_t pix_[SCREEN_WIDTH * SCREEN_HEIGHT] {};
+};
+
+}
+
+// Runs a cabinet headless from power-on, as fast as the host allows, and
+// captures its screen to a Y4M file and its sound to a WAV file. It plays
+// the inputs of a movie, or leaves the cabinet in attract mode for a number
+// of frames.
+int main(int argc, char *argv[])
+{
+	// usage: capture [--frames n] [--movie file] [--y4m file] [--wav file] [rom]
+	long frames {3600};
+	std::string movie_path, y4m, wav, rom {"invaders.rom"};
+	for (int i {1}; i < argc; ++i)
+	{
+		std::string arg {argv[i]};
+		if (arg == "--frames" && i + 1 < argc)
+			frames = std::stol(argv[++i]);
+		else if (arg == "--movie" && i + 1 < argc)
+			movie_path = argv[++i];
+		else if (arg == "--y4m" && i + 1 < argc)
+			y4m = argv[++i];
+		else if (arg == "--wav" && i + 1 < argc)
+			wav = argv[++i];
+		else
+			rom = arg;
+	}
+	if (y4m.empty() && wav.empty())
+	{
+		std::cerr << "usage: capture [--frames n] [--movie file] [--y4m file] [--wav file] [rom]\n";
+		return 2;
+	}
+	space_invaders::Movie movie {};
+	if (!movie_path.empty() && !movie.load(movie_path))
+	{
+		std::cerr << "Could not load movie " << movie_path << '\n';
+		return 2;
+	}
+	space_invaders::Machine cabinet {i8080::Dispatch::threaded};
+	if (!cabinet.load_program(rom))
+	{
+		std::cerr << "Could not open " << rom << '\n';
+		return 2;
+	}
+
+	std::unique_ptr<space_invaders::Y4m_writer> video;
+	if (!y4m.empty())
+		video = std::make_unique<space_invaders::Y4m_writer>(y4m);
+	space_invaders::Mixer mixer {};
+	std::unique_ptr<space_invaders::Wav_writer> writer;
+	std::unique_ptr<space_invaders::Audio_stream> audio;
+	if (!wav.empty())
+	{
+		if (!mixer.load_sounds())
+			std::cerr << "Could not load every sound from audio/\n";
+		writer = std::make_unique<space_invaders::Wav_writer>(wav, mixer.rate());
+		audio = std::make_unique<space_invaders::Audio_stream>(mixer,
+			[&writer](const int16_t *samples, size_t n) { writer->write(samples, n); });
+		cabinet.attach_audio(audio.get());
+	}
+	Capture capture {cabinet, video.get(), audio.get()};
+	cabinet.attach_video(&capture);
+
+	auto start = std::chrono::steady_clock::now();
+	if (movie_path.empty())
+		for (long i {0}; i < frames; ++i)
+			cabinet.step_frame();
+	else
+	{
+		movie.play(cabinet);
+		frames = movie.frames();
+	}
+	bool ok {true};
+	if (video && !video->close())
+	{
+		std::cerr << "Could not write " << y4m << '\n';
+		ok = false;
+	}
+	if (writer && !writer->close())
+	{
+		std::cerr << "Could not write " << wav << '\n';
+		ok = false;
+	}
+	double secs {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+	std::cout << frames << " frames in " << std::fixed << std::setprecision(2) << secs
+		<< " s (" << std::setprecision(0) << frames / 60.0 / secs << "x real time)\n";
+	return ok ? 0 : 1;
+}
@@ -9,610 +9,6 @@
 namespace i8080
 {
 
-Cpu::Cpu(std::array<uint8_t, 0x10000> &a) 
-	: mem_(a)
-{}
-
-Cpu::Cpu(std::array<uint8_t, 0x10000> &a, 
-		 std::function<uint8_t(uint8_t)> in, 
-		 std::function<void(uint8_t, uint8_t)> out) 
-	: mem_(a), 
-	  in_handle_(in), 
-	  out_handle_(out)
-{}
-
-uint16_t Cpu::pair(uint8_t r1, uint8_t r2)
-{
-	return static_cast<uint16_t>(r1) << 8 | static_cast<uint16_t>(r2);
-}
-
-void Cpu::set_pc(uint16_t x)
-{
-	pc_ = x;
-}
-
-int Cpu::cycles() const
-{
-	return cycles_;
-}
-
-uint8_t Cpu::b() const
-{
-	return b_;
-}
-
-uint8_t Cpu::c() const
-{
-	return c_;
-}
-
-uint8_t Cpu::d() const
-{
-	return d_;
-}
-
-uint8_t Cpu::e() const
-{
-	return e_;
-}
-
-uint8_t Cpu::h() const
-{
-	return h_;
-}
-
-uint8_t Cpu::l() const
-{
-	return l_;
-}
-
-uint16_t Cpu::pc() const
-{
-	return pc_;
-}
-
-void Cpu::interrupt(uint8_t op)
-{
-	if (int_enabled_)
-	{
-		int_enabled_ = false;
-		int_pending_ = true;
-		int_op_ = op;
-	}
-}
-
-int Cpu::emulate_op()
-{
-	if (halted_)
-		return -1;
-	uint8_t *opcode {&mem_[pc_]};
-	if (int_pending_)
-	{
-		opcode = &int_op_;
-		int_pending_ = false;
-	}
-	switch (*opcode)
-	{
-		case 0x00: nop();
-			break; 
-		case 0x01: lxi(b_, c_, opcode[1], opcode[2]);
-			break; 
-		case 0x02: stax(b_, c_);
-			break; 
-		case 0x03: inx(b_, c_);
-			break; 
-		case 0x04: inr(b_);
-			break; 
-		case 0x05: dcr(b_);
-			break;
-		case 0x06: mvi(b_, opcode[1]);
-			break;
-		case 0x07: rlc();
-			break;
-		case 0x08: nop();
-			break;
-		case 0x09: dad(b_, c_);
-			break;
-		case 0x0A: ldax(b_, c_);
-			break;
-		case 0x0B: dcx(b_, c_);
-			break;
-		case 0x0C: inr(c_);
-			break;
-		case 0x0D: dcr(c_);
-			break;
-		case 0x0E: mvi(c_, opcode[1]);
-			break;
-		case 0x0F: rrc();
-			break;
-		case 0x10: nop();
-			break;
-		case 0x11: lxi(d_, e_, opcode[1], opcode[2]);
-			break;
-		case 0x12: stax(d_, e_);
-			break;
-		case 0x13: inx(d_, e_);
-			break; 
-		case 0x14: inr(d_);
-			break; 
-		case 0x15: dcr(d_);
-			break; 
-		case 0x16: mvi(d_, opcode[1]);
-			break; 
-		case 0x17: ral();
-			break; 
-		case 0x18: nop();
-			break;
-		case 0x19: dad(d_, e_);
-			break; 
-		case 0x1A: ldax(d_, e_);
-			break; 
-		case 0x1B: dcx(d_, e_);
-			break; 
-		case 0x1C: inr(e_);
-			break; 
-		case 0x1D: dcr(e_);
-			break; 
-		case 0x1E: mvi(e_, opcode[1]);
-			break; 
-		case 0x1F: rar();
-			break; 
-		case 0x20: nop();
-			break;
-		case 0x21: lxi(h_, l_, opcode[1], opcode[2]);
-			break; 
-		case 0x22: shld(opcode[1], opcode[2]);
-			break; 
-		case 0x23: inx(h_, l_);
-			break; 
-		case 0x24: inr(h_);
-			break; 
-		case 0x25: dcr(h_);
-			break; 
-		case 0x26: mvi(h_, opcode[1]);
-			break; 
-		case 0x27: daa();
-			break; 
-		case 0x28: nop();
-			break; 
-		case 0x29: dad(h_, l_);
-			break; 
-		case 0x2A: lhld(opcode[1], opcode[2]);
-			break; 
-		case 0x2B: dcx(h_, l_);
-			break; 
-		case 0x2C: inr(l_);
-			break; 
-		case 0x2D: dcr(l_);
-			break; 
-		case 0x2E: mvi(l_, opcode[1]);
-			break; 
-		case 0x2F: cma();
-			break;
-		case 0x30: nop();
-			break;
-		case 0x31: lxi(sp_, opcode[1], opcode[2]);
-			break;
-		case 0x32: sta(opcode[1], opcode[2]);
-			break;
-		case 0x33: inx(sp_);
-			break;
-		case 0x34: inr_m();
-			break;
-		case 0x35: dcr_m();
-			break;
-		case 0x36: mvi_m(opcode[1]);
-			break;
-		case 0x37: stc();
-			break;
-		case 0x38: nop();
-			break;
-		case 0x39: dad(sp_);
-			break;
-		case 0x3A: lda(opcode[1], opcode[2]);
-			break;
-		case 0x3B: dcx(sp_);
-			break;
-		case 0x3C: inr(a_);
-			break;
-		case 0x3D: dcr(a_);
-			break;
-		case 0x3E: mvi(a_, opcode[1]);
-			break;
-		case 0x3F: cmc();
-			break;
-		case 0x40: mov(b_, b_);
-			break;
-		case 0x41: mov(b_, c_);
-			break;
-		case 0x42: mov(b_, d_);
-			break; 
-		case 0x43: mov(b_, e_);
-			break;
-		case 0x44: mov(b_, h_);
-			break;
-		case 0x45: mov(b_, l_);
-			break;
-		case 0x46: mov_r(b_);
-			break;
-		case 0x47: mov(b_, a_);
-			break;
-		case 0x48: mov(c_, b_);
-			break; 
-		case 0x49: mov(c_, c_);
-			break; 
-		case 0x4A: mov(c_, d_);
-			break; 
-		case 0x4B: mov(c_, e_);
-			break; 
-		case 0x4C: mov(c_, h_);
-			break; 
-		case 0x4D: mov(c_, l_);
-			break; 
-		case 0x4E: mov_r(c_);
-			break; 
-		case 0x4F: mov(c_, a_);
-			break;
-		case 0x50: mov(d_, b_);
-			break; 
-		case 0x51: mov(d_, c_);
-			break; 
-		case 0x52: mov(d_, d_);
-			break; 
-		case 0x53: mov(d_, e_);
-			break; 
-		case 0x54: mov(d_, h_);
-			break; 
-		case 0x55: mov(d_, l_);
-			break; 
-		case 0x56: mov_r(d_);
-			break; 
-		case 0x57: mov(d_, a_);
-			break;
-		case 0x58: mov(e_, b_);
-			break; 
-		case 0x59: mov(e_, c_);
-			break; 
-		case 0x5A: mov(e_, d_);
-			break; 
-		case 0x5B: mov(e_, e_);
-			break; 
-		case 0x5C: mov(e_, h_);
-			break; 
-		case 0x5D: mov(e_, l_);
-			break; 
-		case 0x5E: mov_r(e_);
-			break; 
-		case 0x5F: mov(e_, a_);
-			break;
-		case 0x60: mov(h_, b_);
-			break; 
-		case 0x61: mov(h_, c_);
-			break; 
-		case 0x62: mov(h_, d_);
-			break; 
-		case 0x63: mov(h_, e_);
-			break; 
-		case 0x64: mov(h_, h_);
-			break; 
-		case 0x65: mov(h_, l_);
-			break; 
-		case 0x66: mov_r(h_);
-			break; 
-		case 0x67: mov(h_, a_);
-			break;
-		case 0x68: mov(l_, b_);
-			break; 
-		case 0x69: mov(l_, c_);
-			break; 
-		case 0x6A: mov(l_, d_);
-			break; 
-		case 0x6B: mov(l_, e_);
-			break; 
-		case 0x6C: mov(l_, h_);
-			break; 
-		case 0x6D: mov(l_, l_);
-			break; 
-		case 0x6E: mov_r(l_);
-			break; 
-		case 0x6F: mov(l_, a_);
-			break;
-		case 0x70: mov_m(b_);
-			break;
-		case 0x71: mov_m(c_);
-			break;
-		case 0x72: mov_m(d_);
-			break;
-		case 0x73: mov_m(e_);
-			break;
-		case 0x74: mov_m(h_);
-			break;
-		case 0x75: mov_m(l_);
-			break;
-		case 0x76: hlt();
-			break;
-		case 0x77: mov_m(a_);
-			break;
-		case 0x78: mov(a_, b_);
-			break; 
-		case 0x79: mov(a_, c_);
-			break; 
-		case 0x7A: mov(a_, d_);
-			break; 
-		case 0x7B: mov(a_, e_);
-			break; 
-		case 0x7C: mov(a_, h_);
-			break; 
-		case 0x7D: mov(a_, l_);
-			break; 
-		case 0x7E: mov_r(a_);
-			break; 
-		case 0x7F: mov(a_, a_);
-			break;
-		case 0x80: add(b_);
-			break;
-		case 0x81: add(c_);
-			break;
-		case 0x82: add(d_);
-			break;
-		case 0x83: add(e_);
-			break;
-		case 0x84: add(h_);
-			break;
-		case 0x85: add(l_);
-			break;
-		case 0x86: add_m();
-			break;
-		case 0x87: add(a_);
-			break;
-		case 0x88: adc(b_);
-			break; 
-		case 0x89: adc(c_);
-			break; 
-		case 0x8A: adc(d_);
-			break; 
-		case 0x8B: adc(e_);
-			break; 
-		case 0x8C: adc(h_);
-			break; 
-		case 0x8D: adc(l_);
-			break; 
-		case 0x8E: adc_m();
-			break; 
-		case 0x8F: adc(a_);
-			break;
-		case 0x90: sub(b_);
-			break; 
-		case 0x91: sub(c_);
-			break; 
-		case 0x92: sub(d_);
-			break; 
-		case 0x93: sub(e_);
-			break; 
-		case 0x94: sub(h_);
-			break; 
-		case 0x95: sub(l_);
-			break; 
-		case 0x96: sub_m();
-			break; 
-		case 0x97: sub(a_);
-			break;
-		case 0x98: sbb(b_);
-			break; 
-		case 0x99: sbb(c_);
-			break; 
-		case 0x9A: sbb(d_);
-			break; 
-		case 0x9B: sbb(e_);
-			break; 
-		case 0x9C: sbb(h_);
-			break; 
-		case 0x9D: sbb(l_);
-			break; 
-		case 0x9E: sbb_m();
-			break; 
-		case 0x9F: sbb(a_);
-			break;
-		case 0xA0: ana(b_);
-			break; 
-		case 0xA1: ana(c_);
-			break; 
-		case 0xA2: ana(d_);
-			break; 
-		case 0xA3: ana(e_);
-			break; 
-		case 0xA4: ana(h_);
-			break; 
-		case 0xA5: ana(l_);
-			break; 
-		case 0xA6: ana_m();
-			break; 
-		case 0xA7: ana(a_);
-			break;
-		case 0xA8: xra(b_);
-			break; 
-		case 0xA9: xra(c_);
-			break; 
-		case 0xAA: xra(d_);
-			break; 
-		case 0xAB: xra(e_);
-			break; 
-		case 0xAC: xra(h_);
-			break; 
-		case 0xAD: xra(l_);
-			break; 
-		case 0xAE: xra_m();
-			break; 
-		case 0xAF: xra(a_);
-			break;
-		case 0xB0: ora(b_);
-			break; 
-		case 0xB1: ora(c_);
-			break; 
-		case 0xB2: ora(d_);
-			break; 
-		case 0xB3: ora(e_);
-			break; 
-		case 0xB4: ora(h_);
-			break; 
-		case 0xB5: ora(l_);
-			break; 
-		case 0xB6: ora_m();
-			break; 
-		case 0xB7: ora(a_);
-			break;
-		case 0xB8: cmp(b_);
-			break; 
-		case 0xB9: cmp(c_);
-			break; 
-		case 0xBA: cmp(d_);
-			break; 
-		case 0xBB: cmp(e_);
-			break; 
-		case 0xBC: cmp(h_);
-			break; 
-		case 0xBD: cmp(l_);
-			break; 
-		case 0xBE: cmp_m();
-			break; 
-		case 0xBF: cmp(a_);
-			break;
-		case 0xC0: r_condition(!cf_.z);
-			break;
-		case 0xC1: pop(b_, c_);
-			break;
-		case 0xC2: j_condition(!cf_.z, opcode[1], opcode[2]);
-			break;
-		case 0xC3: jmp(opcode[1], opcode[2]);
-			break;
-		case 0xC4: c_condition(!cf_.z, opcode[1], opcode[2]);
-			break;
-		case 0xC5: push(b_, c_);
-			break;
-		case 0xC6: adi(opcode[1]);
-			break;
-		case 0xC7: rst(0);
-			break;
-		case 0xC8: r_condition(cf_.z);
-			break;
-		case 0xC9: ret();
-			break;
-		case 0xCA: j_condition(cf_.z, opcode[1], opcode[2]);
-			break;
-		case 0xCB: nop();
-			break;
-		case 0xCC: c_condition(cf_.z, opcode[1], opcode[2]);
-			break;
-		case 0xCD: call(opcode[1], opcode[2]);
-			break;
-		case 0xCE: aci(opcode[1]);
-			break;
-		case 0xCF: rst(1);
-			break;
-		case 0xD0: r_condition(!cf_.cy);
-			break;
-		case 0xD1: pop(d_, e_);
-			break;
-		case 0xD2: j_condition(!cf_.cy, opcode[1], opcode[2]);
-			break;
-		case 0xD3: out(opcode[1]);
-			break;
-		case 0xD4: c_condition(!cf_.cy, opcode[1], opcode[2]);
-			break;
-		case 0xD5: push(d_, e_);
-			break;
-		case 0xD6: sui(opcode[1]);
-			break;
-		case 0xD7: rst(2);
-			break;
-		case 0xD8: r_condition(cf_.cy);
-			break;
-		case 0xD9: nop();
-			break;
-		case 0xDA: j_condition(cf_.cy, opcode[1], opcode[2]);
-			break;
-		case 0xDB: in(opcode[1]);
-			break;
-		case 0xDC: c_condition(cf_.cy, opcode[1], opcode[2]);
-			break;
-		case 0xDD: nop();
-			break;
-		case 0xDE: sbi(opcode[1]);
-			break;
-		case 0xDF: rst(3);
-			break;
-		case 0xE0: r_condition(!cf_.p);
-			break;
-		case 0xE1: pop(h_, l_);
-			break;
-		case 0xE2: j_condition(!cf_.p, opcode[1], opcode[2]);
-			break;
-		case 0xE3: xthl();
-			break;
-		case 0xE4: c_condition(!cf_.p, opcode[1], opcode[2]);
-			break;
-		case 0xE5: push(h_, l_);
-			break;
-		case 0xE6: ani(opcode[1]);
-			break;
-		case 0xE7: rst(4);
-			break;
-		case 0xE8: r_condition(cf_.p);
-			break;
-		case 0xE9: pchl();
-			break;
-		case 0xEA: j_condition(cf_.p, opcode[1], opcode[2]);
-			break;
-		case 0xEB: xchg();
-			break;
-		case 0xEC: c_condition(cf_.p, opcode[1], opcode[2]);
-			break;
-		case 0xED: nop();
-			break;
-		case 0xEE: xri(opcode[1]);
-			break;
-		case 0xEF: rst(5);
-			break;
-		case 0xF0: r_condition(!cf_.s);
-			break;
-		case 0xF1: pop_psw();
-			break;
-		case 0xF2: j_condition(!cf_.s, opcode[1], opcode[2]);
-			break;
-		case 0xF3: di();
-			break;
-		case 0xF4: c_condition(!cf_.s, opcode[1], opcode[2]);
-			break;
-		case 0xF5: push_psw();
-			break;
-		case 0xF6: ori(opcode[1]);
-			break;
-		case 0xF7: rst(6);
-			break;
-		case 0xF8: r_condition(cf_.s);
-			break;
-		case 0xF9: sphl();
-			break;
-		case 0xFA: j_condition(cf_.s, opcode[1], opcode[2]);
-			break;
-		case 0xFB: ei();
-			break;
-		case 0xFC: c_condition(cf_.s, opcode[1], opcode[2]);
-			break;
-		case 0xFD: nop();
-			break;
-		case 0xFE: cpi(opcode[1]);
-			break;
-		case 0xFF: rst(7);
-			break;
-	}
-	#ifdef DEBUG
-		++debug_instructions;
-	#endif
-	++pc_;
-	return *opcode;
-}
-
 const std::array<std::pair<std::string, int>, 256> op_codes
 {{
 	{"NOP", 1},
@@ -873,49 +269,29 @@ const std::array<std::pair<std::string, int>, 256> op_codes
 	{"RST 7", 1},
 }};
 
-#ifdef DEBUG
-
-void Cpu::debug_step(int x)
-{
-	for (int i = 0; i < x; ++i)
-	{
-		debug_info(std::cerr);
-		emulate_op();
-	}
-}
-
-void Cpu::debug_info(std::ostream &os)
-{
-	os << "Instructions Ran: " << std::dec << debug_instructions << '\n';
-	os << "Program Counter: " << std::hex << std::uppercase
-		<< std::setfill('0') << std::setw(4)<< pc_ << '\n';
-	os << "Memory Immediate: 0x" 
-		<< std::setw(2) << static_cast<int>(mem_[pc_]) << '\n';
-	os << "Instruction: " << op_codes[mem_[pc_]].first;
-	for (int i = 1; i < op_codes[mem_[pc_]].second; ++i)
-		os << ' ' << static_cast<int>(mem_[pc_+i]);
-	os << '\n' << std::setw(4);
-	os << "Registers (B/C/D/E/H/L/A): "  
-		<< std::setw(2) << static_cast<int>(b_) << ' ' 
-		<< std::setw(2) << static_cast<int>(c_) << ' '
-		<< std::setw(2) << static_cast<int>(d_) << ' ' 
-		<< std::setw(2) << static_cast<int>(e_) << ' '
-		<< std::setw(2) << static_cast<int>(h_) << ' ' 
-		<< std::setw(2) << static_cast<int>(l_) << ' '
-		<< std::setw(2) << static_cast<int>(a_) << '\n';
-	os << "Memory at HL (" << std::setw(4) << static_cast<int>(pair(h_, l_)) << "): "
-		<< std::setw(2) << static_cast<int>(mem_[pair(h_, l_)]) << '\n';
-	os << "Flags (Z/S/P/C/AC): "
-		<< static_cast<int>(cf_.z) << ' ' << static_cast<int>(cf_.s) << ' '
-		<< static_cast<int>(cf_.p) << ' ' << static_cast<int>(cf_.cy) << ' '
-		<< static_cast<int>(cf_.ac) << ' ' << '\n';
-	os << "Stack Pointer: " << static_cast<int>(sp_) << '\n';
-	os << "Cycles: " << std::dec << cycles_ << '\n';
-	os << "Interrupt enabled: " << std::boolalpha << int_enabled_ << '\n';
-	os << "Interrupt op: " << std::hex << static_cast<uint8_t>(int_op_) << '\n';
-	os << std::setfill('-') << std::setw(20) << ' ' << '\n';
-}
+const std::array<uint8_t, 256> op_cycles
+{{
+	4, 10, 7, 5, 5, 5, 7, 4, 4, 10, 7, 5, 5, 5, 7, 4,
+	4, 10, 7, 5, 5, 5, 7, 4, 4, 10, 7, 5, 5, 5, 7, 4,
+	4, 10, 16, 5, 5, 5, 7, 4, 4, 10, 16, 5, 5, 5, 7, 4,
+	4, 10, 13, 5, 10, 10, 10, 4, 4, 10, 13, 5, 5, 5, 7, 4,
+	5, 5, 5, 5, 5, 5, 7, 5, 5, 5, 5, 5, 5, 5, 7, 5,
+	5, 5, 5, 5, 5, 5, 7, 5, 5, 5, 5, 5, 5, 5, 7, 5,
+	5, 5, 5, 5, 5, 5, 7, 5, 5, 5, 5, 5, 5, 5, 7, 5,
+	7, 7, 7, 7, 7, 7, 7, 7, 5, 5, 5, 5, 5, 5, 7, 5,
+	4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	11, 10, 10, 10, 17, 11, 7, 11, 11, 10, 10, 4, 17, 17, 7, 11,
+	11, 10, 10, 10, 17, 11, 7, 11, 11, 4, 10, 10, 17, 4, 7, 11,
+	11, 10, 10, 18, 17, 11, 7, 11, 11, 5, 10, 4, 17, 4, 7, 11,
+	11, 10, 10, 4, 17, 11, 7, 11, 11, 5, 10, 4, 17, 4, 7, 11
+}};
 
-#endif
+// the stock buses, compiled once here
+template class Cpu<Flat_bus>;
+template class Cpu<Paged_bus>;
+template class Cpu<Read_hook_bus>;
 
 }
\ No newline at end of file
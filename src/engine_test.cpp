@@ -0,0 +1,158 @@
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "cpu.hpp"
+#include "machine.hpp"
+
+// Checks every dispatch engine against the switch: random bytes run as code,
+// stopped at random deadlines and interrupted with random RSTs, then the
+// cabinet's own program. Any difference in the registers, flags, memory,
+// cycles or port traffic is a bug in one of them.
+
+namespace
+{
+
+using i8080::Dispatch;
+
+const std::pair<Dispatch, const char *> engines[]
+{
+	{Dispatch::threaded, "threaded"},
+	{Dispatch::block, "block"},
+	{Dispatch::jit, "jit"}
+};
+
+// a cpu on its own memory, logging what it sends to the ports
+struct Rig
+{
+	std::array<uint8_t, 0x10000> mem;
+	std::vector<std::pair<uint8_t, uint8_t>> outs;
+	i8080::Cpu<i8080::Flat_bus> cpu;
+
+	Rig(const std::array<uint8_t, 0x10000> &program, Dispatch d)
+		: mem {program},
+		  cpu
+		  {
+			  i8080::Flat_bus {mem},
+			  i8080::Function_io
+			  {
+				  [](uint8_t port) { return static_cast<uint8_t>(port * 37 + 11); },
+				  [this](uint8_t port, uint8_t val) { outs.emplace_back(port, val); }
+			  },
+			  d
+		  }
+	{
+	}
+};
+
+bool same(const i8080::Cpu_state &x, const i8080::Cpu_state &y)
+{
+	auto key = [](const i8080::Cpu_state &s)
+	{
+		return std::make_tuple(s.b, s.c, s.d, s.e, s.h, s.l, s.a, s.sp, s.pc, s.psw,
+			s.cycles, s.int_enabled, s.int_pending, s.int_op, s.halted);
+	};
+	return key(x) == key(y);
+}
+
+// the first point an engine parts from the switch, or -1 if it never does
+int compare_random(Dispatch d, uint32_t seed, int steps)
+{
+	std::mt19937 rng {seed};
+	std::array<uint8_t, 0x10000> program;
+	for (uint8_t &x : program)
+		x = static_cast<uint8_t>(rng());
+	auto ref = std::make_unique<Rig>(program, Dispatch::switch_case);
+	auto test = std::make_unique<Rig>(program, d);
+	uint64_t deadline {0};
+	for (int step {0}; step < steps; ++step)
+	{
+		deadline += 1 + rng() % 400;
+		ref->cpu.run_until(deadline);
+		test->cpu.run_until(deadline);
+		if (!same(ref->cpu.state(), test->cpu.state()) || ref->mem != test->mem || ref->outs != test->outs)
+			return step;
+		if (rng() % 4 == 0)
+		{
+			uint8_t rst {static_cast<uint8_t>(0xC7 | (rng() % 8) << 3)};
+			ref->cpu.interrupt(rst);
+			test->cpu.interrupt(rst);
+		}
+	}
+	return -1;
+}
+
+// the frame a cabinet running the rom parts from the switch, or -1
+long compare_rom(const std::string &rom, Dispatch d, long frames)
+{
+	space_invaders::Machine ref {Dispatch::switch_case}, test {d};
+	if (!ref.load_program(rom) || !test.load_program(rom))
+		return 0;
+	for (long f {0}; f < frames; ++f)
+	{
+		// a coin and a game for one player, firing now and then
+		const space_invaders::Button presses[] {space_invaders::Button::coin,
+			space_invaders::Button::p1_start, space_invaders::Button::p1_shoot};
+		for (auto b : presses)
+		{
+			if (f % 1000 == 100)
+			{
+				ref.press(b);
+				test.press(b);
+			}
+			else if (f % 1000 == 110)
+			{
+				ref.release(b);
+				test.release(b);
+			}
+		}
+		ref.step_frame();
+		test.step_frame();
+		if (ref.save_state() != test.save_state())
+			return f;
+	}
+	return -1;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	int failures {0};
+	for (const auto &[d, name] : engines)
+	{
+		int bad {0};
+		for (uint32_t seed {1}; seed <= 200; ++seed)
+		{
+			int step {compare_random(d, seed, 300)};
+			if (step >= 0)
+			{
+				if (!bad)
+					std::cout << name << ": random program " << seed << " differs at step " << step << '\n';
+				++bad;
+			}
+		}
+		std::cout << name << ": " << bad << " of 200 random programs differ\n";
+		failures += bad;
+	}
+	std::string rom {argc > 1 ? argv[1] : "invaders.rom"};
+	if (std::ifstream(rom).good())
+		for (const auto &[d, name] : engines)
+		{
+			long frame {compare_rom(rom, d, 5'000)};
+			if (frame >= 0)
+				std::cout << name << ": " << rom << " differs at frame " << frame << '\n';
+			else
+				std::cout << name << ": " << rom << " matches\n";
+			failures += frame >= 0;
+		}
+	else
+		std::cout << "no " << rom << ", skipping the cabinet\n";
+	return failures ? 1 : 0;
+}
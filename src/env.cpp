@@ -0,0 +1,137 @@
+#include "env.hpp"
+
+#include <algorithm>
+
+namespace space_invaders
+{
+
+namespace
+{
+
+// input port 1 bits of the player 1 controls
+constexpr uint8_t coin_bit {1 << 0};
+constexpr uint8_t start_bit {1 << 2};
+constexpr uint8_t fire_bit {1 << 4};
+constexpr uint8_t left_bit {1 << 5};
+constexpr uint8_t right_bit {1 << 6};
+
+constexpr uint8_t action_bits[action_count] {
+	0, fire_bit, left_bit, right_bit, left_bit | fire_bit, right_bit | fire_bit
+};
+
+int from_bcd(uint8_t x)
+{
+	return (x >> 4) * 10 + (x & 0x0F);
+}
+
+}
+
+Env::Env(int frame_skip, i8080::Dispatch d)
+	: machine_ {d},
+	  frame_skip_ {frame_skip}
+{
+}
+
+bool Env::load_program(const std::string &in)
+{
+	if (!machine_.load_program(in))
+		return false;
+	// boot, insert a coin, press start, and wait for the first ship
+	Inputs idle {machine_.inputs()};
+	idle.port1 &= ~(coin_bit | start_bit | fire_bit | left_bit | right_bit);
+	for (int frame {0}; frame < 600; ++frame)
+	{
+		Inputs in {idle};
+		if (frame >= 60 && frame < 65)
+			in.port1 |= coin_bit;
+		if (frame >= 90 && frame < 95)
+			in.port1 |= start_bit;
+		machine_.set_inputs(in);
+		machine_.step_frame();
+		if (frame >= 95 && peek(p1_ships_adr) != 0)
+		{
+			start_ = machine_.save_state();
+			score_ = score();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Env::reset()
+{
+	if (!machine_.load_state(start_))
+		return false;
+	score_ = score();
+	return true;
+}
+
+Env::Step Env::step(Action a)
+{
+	Inputs in {machine_.inputs()};
+	in.port1 &= ~(fire_bit | left_bit | right_bit);
+	in.port1 |= action_bits[static_cast<int>(a)];
+	machine_.set_inputs(in);
+	bool done {false};
+	for (int i {0}; i < frame_skip_ && !done; ++i)
+	{
+		machine_.step_frame();
+		done = peek(game_mode_adr) == 0;
+	}
+	int now {score()};
+	int reward {now - score_};
+	score_ = now;
+	return {reward, done};
+}
+
+Byte_view Env::observation()
+{
+	return {machine_.vram(), vram_size};
+}
+
+Byte_view Env::downsampled(int factor)
+{
+	if (factor < 1)
+		return {small_.data(), 0};
+	int w {(SCREEN_WIDTH + factor - 1) / factor}, h {(SCREEN_HEIGHT + factor - 1) / factor};
+	small_.assign(w * h, 0);
+	const uint8_t *vram {machine_.vram()};
+	constexpr int column_bytes {SCREEN_HEIGHT / 8};
+	for (int bx {0}; bx < w; ++bx)
+	{
+		// OR the columns of a block together first, so each bit is looked
+		// at once per block rather than once per column
+		uint8_t column[column_bytes] {};
+		for (int x {bx * factor}; x < std::min((bx + 1) * factor, SCREEN_WIDTH); ++x)
+			for (int k {0}; k < column_bytes; ++k)
+				column[k] |= vram[x * column_bytes + k];
+		for (int k {0}; k < column_bytes; ++k)
+		{
+			for (int b {0}; column[k] >> b; ++b)
+			{
+				if (!(column[k] >> b & 1))
+					continue;
+				int y {SCREEN_HEIGHT - 1 - (k * 8 + b)}; // columns run bottom to top
+				small_[y / factor * w + bx] = 1;
+			}
+		}
+	}
+	return {small_.data(), small_.size()};
+}
+
+int Env::score()
+{
+	return from_bcd(peek(p1_score_adr)) + 100 * from_bcd(peek(p1_score_adr + 1));
+}
+
+Machine &Env::machine()
+{
+	return machine_;
+}
+
+uint8_t Env::peek(uint16_t adr)
+{
+	return machine_.cpu().bus().read(adr);
+}
+
+}
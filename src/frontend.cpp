@@ -0,0 +1,236 @@
+#include "frontend.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+namespace space_invaders
+{
+
+namespace
+{
+	constexpr std::chrono::duration<double, std::milli> tic {1000.0 / 60.0};
+}
+
+Frontend::Frontend(bool turbo)
+	: turbo_ {turbo},
+	window_ {SDL_CreateWindow("Space Invaders!", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+		SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_RESIZABLE)},
+	disp_ {SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, 0, 0, 0, 0)},
+	stream_ {mixer_, [this](const int16_t *samples, size_t n) { device_.queue(samples, n); }}
+{
+	if (!window_)
+	{
+		std::cerr << "Could not create SDL_Window!\n";
+		throw;
+	}
+	if (!disp_)
+	{
+		std::cerr << "Could not create SDL_Surface!\n";
+		throw;
+	}
+	// the same format as disp_, with no alpha to blend by
+	renderer_ = SDL_CreateRenderer(window_, -1, SDL_RENDERER_ACCELERATED);
+	if (renderer_)
+		texture_ = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING,
+			SCREEN_WIDTH, SCREEN_HEIGHT);
+	if (renderer_ && !texture_)
+	{
+		SDL_DestroyRenderer(renderer_);
+		renderer_ = nullptr;
+	}
+	if (!mixer_.load_sounds())
+		std::cerr << "Could not load every sound from audio/\n";
+}
+
+Frontend::~Frontend()
+{
+	if (texture_)
+		SDL_DestroyTexture(texture_);
+	if (renderer_)
+		SDL_DestroyRenderer(renderer_);
+	SDL_FreeSurface(disp_);
+	SDL_DestroyWindow(window_);
+}
+
+void Frontend::run(Machine &m, Movie *movie)
+{
+	SDL_Event e;
+	Button b;
+	auto next_tic = Clock::now();
+	while (!done_)
+	{
+		while (SDL_PollEvent(&e))
+		{
+			if (e.type == SDL_QUIT)
+				done_ = true;
+			else if (e.type == SDL_KEYDOWN)
+			{
+				switch (e.key.keysym.sym)
+				{
+					#ifdef DEBUG
+					case SDLK_t:
+						m.cpu().debug_info();
+						break;
+					#endif
+					case SDLK_BACKSPACE: // hold to rewind
+						rewinding_ = true;
+						break;
+					default:
+						if (button(e.key.keysym.sym, b))
+							m.press(b);
+				}
+			}
+			else if (e.type == SDL_KEYUP)
+			{
+				if (e.key.keysym.sym == SDLK_BACKSPACE)
+					rewinding_ = false;
+				else if (button(e.key.keysym.sym, b))
+					m.release(b);
+			}
+		}
+		if (rewinding_ && rewind_.step_back(m))
+			draw(m.vram(), Column_mask {}.set()); // the whole screen changed
+		else
+		{
+			if (movie)
+				movie->record(m);
+			m.step_frame();
+			rewind_.record(m);
+		}
+		stream_.advance(m.cpu().cycles()); // the frame's sound, to the sample
+		if (turbo_)
+			continue;
+		// sleep until the next tic instead of spinning on the clock; if we
+		// fell behind, start counting again from now rather than catching up
+		next_tic += std::chrono::duration_cast<Clock::duration>(tic);
+		auto now = Clock::now();
+		if (next_tic < now)
+			next_tic = now;
+		else
+			std::this_thread::sleep_until(next_tic);
+	}
+	if (movie)
+		movie->finish(m);
+}
+
+void Frontend::draw(const uint8_t *vram, const Column_mask &dirty)
+{
+	pending_ |= dirty;
+	if (turbo_)
+	{
+		auto now = Clock::now();
+		if (now - last_present_ < tic)
+			return;
+		last_present_ = now;
+	}
+	expand_columns(vram, static_cast<uint32_t *>(disp_->pixels), pending_);
+	present(pending_);
+	pending_.reset();
+}
+
+// uploads the 8-column tiles from the first dirty column to the last, the
+// ones expand_columns rewrote
+void Frontend::present(const Column_mask &dirty)
+{
+	if (!texture_)
+	{
+		present_software();
+		return;
+	}
+	if (dirty.any())
+	{
+		int first {0}, last {SCREEN_WIDTH - 1};
+		while (!dirty[first])
+			++first;
+		while (!dirty[last])
+			--last;
+		first &= ~7;
+		last |= 7;
+		SDL_Rect area {first, 0, last - first + 1, SCREEN_HEIGHT};
+		const uint32_t *pix {static_cast<const uint32_t *>(disp_->pixels)};
+		if (SDL_UpdateTexture(texture_, &area, pix + first, disp_->pitch))
+			std::cerr << SDL_GetError();
+	}
+	SDL_RenderCopy(renderer_, texture_, NULL, NULL);
+	SDL_RenderPresent(renderer_);
+}
+
+// the largest whole scale that fits, with black borders; surfaces that
+// aren't 32 bits a pixel go through SDL's own scaler
+void Frontend::present_software()
+{
+	SDL_Surface *winsurf = SDL_GetWindowSurface(window_);
+	if (!winsurf)
+		return;
+	int scale {std::min(winsurf->w / SCREEN_WIDTH, winsurf->h / SCREEN_HEIGHT)};
+	if (winsurf->format->BytesPerPixel != 4 || scale < 1)
+		SDL_BlitScaled(disp_, NULL, winsurf, NULL);
+	else
+	{
+		if (winsurf->w != surface_w_ || winsurf->h != surface_h_)
+		{
+			SDL_FillRect(winsurf, NULL, 0);
+			surface_w_ = winsurf->w;
+			surface_h_ = winsurf->h;
+		}
+		int x {(winsurf->w - scale * SCREEN_WIDTH) / 2};
+		int y {(winsurf->h - scale * SCREEN_HEIGHT) / 2};
+		int pitch {winsurf->pitch / 4};
+		SDL_LockSurface(winsurf);
+		scale_frame(static_cast<const uint32_t *>(disp_->pixels),
+			static_cast<uint32_t *>(winsurf->pixels) + y * pitch + x, pitch, scale);
+		SDL_UnlockSurface(winsurf);
+	}
+	if (SDL_UpdateWindowSurface(window_))
+		std::cerr << SDL_GetError();
+}
+
+void Frontend::play(Sound s, uint64_t cycle)
+{
+	stream_.play(s, cycle);
+}
+
+void Frontend::stop(Sound s, uint64_t cycle)
+{
+	stream_.stop(s, cycle);
+}
+
+bool Frontend::button(SDL_Keycode k, Button &b)
+{
+	switch (k)
+	{
+		case SDLK_c: // insert coin
+			b = Button::coin;
+			break;
+		case SDLK_s: // P1 Start
+			b = Button::p1_start;
+			break;
+		case SDLK_w: // P1 Shoot
+			b = Button::p1_shoot;
+			break;
+		case SDLK_a: // P1 left
+			b = Button::p1_left;
+			break;
+		case SDLK_d: // P1 right
+			b = Button::p1_right;
+			break;
+		case SDLK_LEFT: // P2 left
+			b = Button::p2_left;
+			break;
+		case SDLK_RIGHT: // P2 right
+			b = Button::p2_right;
+			break;
+		case SDLK_RETURN: // P2 start
+			b = Button::p2_start;
+			break;
+		case SDLK_UP: // P2 shoot
+			b = Button::p2_shoot;
+			break;
+		default:
+			return false;
+	}
+	return true;
+}
+
+}
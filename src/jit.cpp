@@ -0,0 +1,1153 @@
+#include "jit.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+
+#include "cpu.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#define I8080_JIT_X64
+	#ifdef _WIN32
+		#include <windows.h>
+	#else
+		#include <sys/mman.h>
+	#endif
+#endif
+
+namespace i8080
+{
+
+namespace
+{
+
+constexpr size_t arena_size {4 << 20};
+
+// host registers
+enum Reg
+{
+	rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+	r8, r9, r10, r11, r12, r13, r14, r15
+};
+
+// the registers of running code: all callee-saved, so helper calls keep them
+constexpr Reg cpu_reg {r15}; // the Cpu
+constexpr Reg hl_reg {rbx}; // H << 8 | L, so H and L are bh and bl
+constexpr Reg bc_reg {r12};
+constexpr Reg de_reg {r13};
+constexpr Reg a_reg {r14};
+constexpr Reg cycles_reg {rbp};
+
+#ifdef _WIN32
+	constexpr Reg arg0 {rcx}, arg1 {rdx}, arg2 {r8};
+#else
+	constexpr Reg arg0 {rdi}, arg1 {rsi}, arg2 {rdx};
+#endif
+
+// the frame of running code, above the helpers' shadow space
+constexpr int deadline_slot {32};
+constexpr int dropped_slot {40}; // writes of an instruction that dropped code
+constexpr int scratch_slot {48};
+constexpr int frame_size {72}; // keeps calls 16-byte aligned
+
+// x86 condition codes
+enum Cond
+{
+	cc_c = 0x2, cc_nc = 0x3, cc_z = 0x4, cc_nz = 0x5,
+	cc_a = 0x7, cc_s = 0x8, cc_p = 0xA
+};
+
+// 8080 flags, as bits of a mask; lahf gives x86's in the same bits
+constexpr int fz {z_flag}, fs {s_flag}, fp {p_flag}, fcy {cy_flag}, fac {ac_flag}, all_flags {psw_mask};
+
+// what an arithmetic instruction's x86 flags mean for the 8080's
+enum class Flag_kind
+{
+	add, // all of them as they are
+	sub, // AC is the complement of x86's AF
+	sbb, // also, Z is only set when the 16-bit difference is 0
+	logic, // CY is clear, and so is AC
+	ana // AC is bit 3 of dl, which holds both operands or'd together
+};
+
+class Asm
+{
+	public:
+	Asm(uint8_t *begin, uint8_t *end)
+		: p_ {begin},
+		  end_ {end}
+	{}
+
+	uint8_t *here() const { return p_; }
+	bool overflow() const { return overflow_; }
+
+	void byte(int b)
+	{
+		if (p_ < end_)
+			*p_++ = static_cast<uint8_t>(b);
+		else
+			overflow_ = true;
+	}
+
+	void bytes(std::initializer_list<int> bs)
+	{
+		for (int b : bs)
+			byte(b);
+	}
+
+	void imm16(int v)
+	{
+		byte(v);
+		byte(v >> 8);
+	}
+
+	void imm32(uint32_t v)
+	{
+		for (int i {0}; i < 4; ++i)
+			byte(v >> 8 * i);
+	}
+
+	void imm64(uint64_t v)
+	{
+		for (int i {0}; i < 8; ++i)
+			byte(v >> 8 * i);
+	}
+
+	void rex(bool w, int r, int rm)
+	{
+		int prefix {0x40 | w << 3 | (r >> 3) << 2 | rm >> 3};
+		if (prefix != 0x40)
+			byte(prefix);
+	}
+
+	// op reg, [base + disp32]
+	void mem(std::initializer_list<int> op, int r, int base, int32_t disp, bool w = false, int prefix = 0)
+	{
+		if (prefix)
+			byte(prefix);
+		rex(w, r, base);
+		bytes(op);
+		byte(0x80 | (r & 7) << 3 | (base & 7));
+		if ((base & 7) == rsp)
+			byte(0x24);
+		imm32(disp);
+	}
+
+	// op reg, rm, both registers; byte registers 4-7 are ah to bh only
+	// where no REX prefix is needed
+	void reg(std::initializer_list<int> op, int r, int rm, bool w = false, int prefix = 0)
+	{
+		if (prefix)
+			byte(prefix);
+		rex(w, r, rm);
+		bytes(op);
+		byte(0xC0 | (r & 7) << 3 | (rm & 7));
+	}
+
+	// a jump to be bound later; returns where its rel32 goes
+	uint8_t *jump(std::initializer_list<int> op)
+	{
+		bytes(op);
+		uint8_t *at {p_};
+		imm32(0);
+		return at;
+	}
+
+	void patch(uint8_t *at, const uint8_t *target)
+	{
+		if (overflow_)
+			return;
+		int32_t rel {static_cast<int32_t>(target - (at + 4))};
+		std::memcpy(at, &rel, 4);
+	}
+
+	void bind(uint8_t *at)
+	{
+		patch(at, p_);
+	}
+
+	void jmp(const uint8_t *target)
+	{
+		patch(jump({0xE9}), target);
+	}
+
+	private:
+	uint8_t *p_, *end_;
+	bool overflow_ {false};
+};
+
+// flags an opcode reads and sets, for dropping the dead ones
+int uses(uint8_t op)
+{
+	switch (op)
+	{
+		case 0x17: case 0x1F: case 0x3F: // RAL, RAR, CMC
+			return fcy;
+		case 0xF5: // PUSH PSW
+			return all_flags;
+	}
+	if ((op >= 0x88 && op <= 0x8F) || (op >= 0x98 && op <= 0x9F) || op == 0xCE || op == 0xDE)
+		return fcy; // ADC, SBB
+	if (op >= 0xC0 && (op & 0x07) % 2 == 0 && (op & 0x07) != 6)
+	{
+		// conditional returns, jumps and calls
+		constexpr int cond[4] {fz, fcy, fp, fs};
+		return cond[(op >> 4) & 3];
+	}
+	return 0;
+}
+
+int sets(uint8_t op)
+{
+	switch (op)
+	{
+		case 0x07: case 0x0F: case 0x17: case 0x1F: // rotates
+		case 0x09: case 0x19: case 0x29: case 0x39: // DAD
+		case 0x37: case 0x3F: // STC, CMC
+			return fcy;
+		case 0xF1: // POP PSW
+			return all_flags;
+	}
+	if (op < 0x40 && ((op & 0x07) == 4 || (op & 0x07) == 5))
+		return fz | fs | fp | fac; // INR, DCR
+	if ((op >= 0x80 && op <= 0xBF) || (op >= 0xC6 && (op & 0x07) == 6))
+		return all_flags;
+	return 0;
+}
+
+bool writes(uint8_t op)
+{
+	switch (op)
+	{
+		case 0x02: case 0x12: case 0x22: case 0x32:
+		case 0x34: case 0x35: case 0x36:
+		case 0xC5: case 0xD5: case 0xE5: case 0xF5:
+		case 0xCD:
+			return true;
+	}
+	if (op >= 0xC4 && (op & 0x07) == 4)
+		return true; // conditional calls
+	return op >= 0x70 && op <= 0x77 && op != 0x76;
+}
+
+bool translatable(uint8_t op)
+{
+	switch (op)
+	{
+		case 0x27: // DAA
+		case 0x76: // HLT
+		case 0xD3: case 0xDB: // OUT, IN
+		case 0xE3: // XTHL
+		case 0xF3: case 0xFB: // DI, EI
+			return false;
+	}
+	return !(op >= 0xC0 && (op & 0x07) == 7); // RST
+}
+
+// whether the block goes on after op, rather than jumping somewhere
+bool falls_through(uint8_t op)
+{
+	switch (op)
+	{
+		case 0xC3: case 0xC9: case 0xCD: case 0xE9:
+			return false;
+	}
+	int low {op & 0x07};
+	return !(op >= 0xC0 && (low == 0 || low == 2 || low == 4));
+}
+
+}
+
+// turns one block into code; see Jit::compile
+class Jit_compiler
+{
+	public:
+	Jit_compiler(Jit &jit, Asm &a)
+		: jit_ {jit},
+		  l_ {jit.layout_},
+		  a_ {a}
+	{}
+
+	void block(uint16_t pc, const uint8_t (*code)[3], int count);
+
+	private:
+	Jit &jit_;
+	const Jit_layout &l_;
+	Asm &a_;
+	int cycles_ {0}, count_ {0}; // run since the last add to the counters
+	std::vector<uint8_t *> deadline_exits_;
+
+	void op(uint16_t pc, const uint8_t *code, int live);
+
+	// registers
+	void get(int r, Reg dst);
+	void put(int r);
+	void load_carry(Reg dst);
+	void store_flags(int want, Flag_kind kind);
+	void store_carry(int want);
+
+	// memory
+	void read(Reg adr);
+	void read(uint16_t adr);
+	void write(Reg adr, Reg val);
+	void write(uint16_t adr, Reg val);
+	void call(const void *f);
+	void drop_check(uint16_t next, int extra_cycles);
+	void sp_adr(int delta);
+
+	// control
+	void count(int extra_cycles);
+	void exit(uint16_t pc, Jit::Exit why, int extra_cycles);
+	void exit_dynamic(Jit::Exit why);
+	void chain(uint16_t target, int extra_cycles);
+	void chain_dynamic(int extra_cycles);
+	uint8_t *branch_if(uint8_t op);
+	void ret(int extra_cycles);
+
+	void alu(int kind, int live);
+};
+
+// a byte register into dst, zero-extended; B C D E H L (M) A as in opcodes
+void Jit_compiler::get(int r, Reg dst)
+{
+	switch (r)
+	{
+		case 0: // B
+			a_.reg({0x89}, bc_reg, dst);
+			a_.reg({0xC1}, 5, dst);
+			a_.byte(8);
+			break;
+		case 1: // C
+			a_.reg({0x0F, 0xB6}, dst, bc_reg);
+			break;
+		case 2: // D
+			a_.reg({0x89}, de_reg, dst);
+			a_.reg({0xC1}, 5, dst);
+			a_.byte(8);
+			break;
+		case 3: // E
+			a_.reg({0x0F, 0xB6}, dst, de_reg);
+			break;
+		case 4: // H: movzx dst, bh
+			a_.reg({0x0F, 0xB6}, dst, 7);
+			break;
+		case 5: // L
+			a_.reg({0x0F, 0xB6}, dst, hl_reg);
+			break;
+		case 7: // A
+			a_.reg({0x89}, a_reg, dst);
+			break;
+	}
+}
+
+// al into a byte register; may change the flags
+void Jit_compiler::put(int r)
+{
+	auto high = [this](Reg pair)
+	{
+		a_.reg({0x0F, 0xB6}, rax, rax);
+		a_.reg({0xC1}, 4, rax);
+		a_.byte(8);
+		a_.reg({0x0F, 0xB6}, pair, pair);
+		a_.reg({0x09}, rax, pair);
+	};
+	switch (r)
+	{
+		case 0:
+			high(bc_reg);
+			break;
+		case 1:
+			a_.reg({0x88}, rax, bc_reg);
+			break;
+		case 2:
+			high(de_reg);
+			break;
+		case 3:
+			a_.reg({0x88}, rax, de_reg);
+			break;
+		case 4: // mov bh, al
+			a_.reg({0x88}, rax, 7);
+			break;
+		case 5:
+			a_.reg({0x88}, rax, hl_reg);
+			break;
+		case 7:
+			a_.reg({0x0F, 0xB6}, a_reg, rax);
+			break;
+	}
+}
+
+// CY into bit 0 of dst and the x86 carry
+void Jit_compiler::load_carry(Reg dst)
+{
+	a_.mem({0x0F, 0xB6}, dst, cpu_reg, l_.psw);
+	a_.reg({0x0F, 0xBA}, 4, dst); // bt dst, 0
+	a_.byte(0);
+}
+
+// stores the wanted flags from the x86 flags of the last instruction; for
+// ANA, dl holds AC. Leaves al alone.
+void Jit_compiler::store_flags(int want, Flag_kind kind)
+{
+	if (!want)
+		return;
+	a_.byte(0x9F); // lahf
+	if (kind == Flag_kind::sbb && (want & fz))
+		a_.bytes({0x73, 0x03, 0x80, 0xE4, 0xFF & ~fz}); // jnc +3; and ah, ~Z
+	if (kind == Flag_kind::sub || kind == Flag_kind::sbb)
+		a_.bytes({0x80, 0xF4, fac}); // xor ah, AC
+	else if (kind != Flag_kind::add)
+		a_.bytes({0x80, 0xE4, 0xFF & ~fac}); // and ah, ~AC
+	if (kind == Flag_kind::ana)
+	{
+		a_.bytes({0x80, 0xE2, 0x08}); // and dl, 8
+		a_.bytes({0x00, 0xD2}); // add dl, dl
+		a_.bytes({0x08, 0xD4}); // or ah, dl
+	}
+	a_.bytes({0x88, 0xE2}); // mov dl, ah
+	if (want == all_flags)
+	{
+		a_.mem({0x88}, rdx, cpu_reg, l_.psw);
+		return;
+	}
+	a_.bytes({0x80, 0xE2, want}); // and dl, want
+	a_.mem({0x80}, 4, cpu_reg, l_.psw); // and byte [psw], ~want
+	a_.byte(0xFF & ~want);
+	a_.mem({0x08}, rdx, cpu_reg, l_.psw); // or [psw], dl
+}
+
+// CY from the x86 carry
+void Jit_compiler::store_carry(int want)
+{
+	if (!(want & fcy))
+		return;
+	a_.reg({0x0F, 0x90 + cc_c}, 0, rdx); // setc dl
+	a_.mem({0x80}, 4, cpu_reg, l_.psw);
+	a_.byte(0xFF & ~fcy);
+	a_.mem({0x08}, rdx, cpu_reg, l_.psw);
+}
+
+void Jit_compiler::call(const void *f)
+{
+	a_.reg({0x89}, cpu_reg, arg0, true);
+	a_.rex(true, 0, rax);
+	a_.byte(0xB8);
+	a_.imm64(reinterpret_cast<uintptr_t>(f));
+	a_.bytes({0xFF, 0xD0});
+}
+
+// the byte at adr into eax
+void Jit_compiler::read(Reg adr)
+{
+	a_.reg({0x0F, 0xB7}, arg1, adr);
+	call(reinterpret_cast<const void *>(jit_.read_));
+	a_.bytes({0x0F, 0xB6, 0xC0});
+}
+
+void Jit_compiler::read(uint16_t adr)
+{
+	a_.rex(false, 0, arg1);
+	a_.byte(0xB8 + (arg1 & 7));
+	a_.imm32(adr);
+	call(reinterpret_cast<const void *>(jit_.read_));
+	a_.bytes({0x0F, 0xB6, 0xC0});
+}
+
+// the low byte of val to adr, leaving in al whether that dropped code; val
+// is never in an argument register other than its own
+void Jit_compiler::write(Reg adr, Reg val)
+{
+	a_.reg({0x0F, 0xB6}, arg2, val);
+	a_.reg({0x0F, 0xB7}, arg1, adr);
+	call(reinterpret_cast<const void *>(jit_.write_));
+}
+
+void Jit_compiler::write(uint16_t adr, Reg val)
+{
+	a_.reg({0x0F, 0xB6}, arg2, val);
+	a_.rex(false, 0, arg1);
+	a_.byte(0xB8 + (arg1 & 7));
+	a_.imm32(adr);
+	call(reinterpret_cast<const void *>(jit_.write_));
+}
+
+// leaves translated code with pc at next if a write dropped code
+void Jit_compiler::drop_check(uint16_t next, int extra_cycles)
+{
+	a_.bytes({0x84, 0xC0}); // test al, al
+	uint8_t *skip {a_.jump({0x0F, 0x80 + cc_z})};
+	exit(next, Jit::Exit::dropped, extra_cycles);
+	a_.bind(skip);
+}
+
+// sp + delta into eax
+void Jit_compiler::sp_adr(int delta)
+{
+	a_.mem({0x0F, 0xB7}, rax, cpu_reg, l_.sp);
+	if (delta)
+	{
+		a_.reg({0x83}, 0, rax);
+		a_.byte(delta);
+	}
+}
+
+// adds what ran since the last time to the counters
+void Jit_compiler::count(int extra_cycles)
+{
+	int cycles {cycles_ + extra_cycles};
+	if (cycles)
+	{
+		a_.reg({0x81}, 0, cycles_reg, true);
+		a_.imm32(cycles);
+	}
+	if (count_ && l_.instructions >= 0)
+	{
+		a_.mem({0x81}, 0, cpu_reg, l_.instructions, true);
+		a_.imm32(count_);
+	}
+}
+
+void Jit_compiler::exit(uint16_t pc, Jit::Exit why, int extra_cycles)
+{
+	count(extra_cycles);
+	a_.mem({0xC7}, 0, cpu_reg, l_.pc, false, 0x66);
+	a_.imm16(pc);
+	a_.byte(0xB8);
+	a_.imm32(static_cast<uint32_t>(why));
+	a_.jmp(jit_.exit_);
+}
+
+// the same with pc in ecx; the counters are already up to date
+void Jit_compiler::exit_dynamic(Jit::Exit why)
+{
+	a_.mem({0x89}, rcx, cpu_reg, l_.pc, false, 0x66);
+	a_.byte(0xB8);
+	a_.imm32(static_cast<uint32_t>(why));
+	a_.jmp(jit_.exit_);
+}
+
+// goes on at target, straight into its translation if it has one
+void Jit_compiler::chain(uint16_t target, int extra_cycles)
+{
+	count(extra_cycles);
+	a_.rex(true, 0, rax);
+	a_.byte(0xB8);
+	a_.imm64(reinterpret_cast<uintptr_t>(&jit_.entries_[target]));
+	a_.bytes({0x48, 0x8B, 0x00}); // mov rax, [rax]
+	a_.bytes({0x48, 0x85, 0xC0}); // test rax, rax
+	uint8_t *missing {a_.jump({0x0F, 0x80 + cc_z})};
+	a_.bytes({0xFF, 0xE0}); // jmp rax
+	a_.bind(missing);
+	a_.mem({0xC7}, 0, cpu_reg, l_.pc, false, 0x66);
+	a_.imm16(target);
+	a_.byte(0xB8);
+	a_.imm32(static_cast<uint32_t>(Jit::Exit::lookup));
+	a_.jmp(jit_.exit_);
+}
+
+// the same with the target in ecx
+void Jit_compiler::chain_dynamic(int extra_cycles)
+{
+	count(extra_cycles);
+	a_.rex(true, 0, rax);
+	a_.byte(0xB8);
+	a_.imm64(reinterpret_cast<uintptr_t>(jit_.entries_.data()));
+	a_.bytes({0x48, 0x8B, 0x04, 0xC8}); // mov rax, [rax + rcx * 8]
+	a_.bytes({0x48, 0x85, 0xC0});
+	uint8_t *missing {a_.jump({0x0F, 0x80 + cc_z})};
+	a_.bytes({0xFF, 0xE0});
+	a_.bind(missing);
+	exit_dynamic(Jit::Exit::lookup);
+}
+
+// tests the condition of a conditional jump, call or return; returns the
+// jump taken when it holds
+uint8_t *Jit_compiler::branch_if(uint8_t op)
+{
+	constexpr int masks[4] {fz, fcy, fp, fs};
+	a_.mem({0xF6}, 0, cpu_reg, l_.psw); // test byte [psw], mask
+	a_.byte(masks[(op >> 4) & 3]);
+	bool set {(op & 0x08) != 0};
+	return a_.jump({0x0F, 0x80 + (set ? cc_nz : cc_z)});
+}
+
+void Jit_compiler::ret(int extra_cycles)
+{
+	sp_adr(0);
+	read(rax);
+	a_.mem({0x88}, rax, rsp, scratch_slot);
+	sp_adr(1);
+	read(rax);
+	a_.mem({0x0F, 0xB6}, rcx, rsp, scratch_slot);
+	a_.reg({0xC1}, 4, rax);
+	a_.byte(8);
+	a_.reg({0x09}, rax, rcx);
+	a_.mem({0x83}, 0, cpu_reg, l_.sp, false, 0x66); // add word [sp], 2
+	a_.byte(2);
+	chain_dynamic(extra_cycles);
+}
+
+// A = A op cl, where kind is the ALU group of the opcode (ADD ADC SUB SBB
+// ANA XRA ORA CMP)
+void Jit_compiler::alu(int kind, int live)
+{
+	get(7, rax);
+	int want {sets(0x80) & live};
+	if (kind == 4)
+	{
+		// ANA sets AC from bit 3 of either operand
+		a_.reg({0x89}, rax, rdx);
+		a_.reg({0x09}, rcx, rdx);
+	}
+	if (kind == 1 || kind == 3)
+		load_carry(rdx);
+	constexpr int ops[8] {0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38};
+	a_.reg({ops[kind]}, rcx, rax);
+	switch (kind)
+	{
+		case 0: case 1:
+			store_flags(want, Flag_kind::add);
+			break;
+		case 2: case 7:
+			store_flags(want, Flag_kind::sub);
+			break;
+		case 3:
+			store_flags(want, Flag_kind::sbb);
+			break;
+		case 4:
+			store_flags(want, Flag_kind::ana);
+			break;
+		default:
+			store_flags(want, Flag_kind::logic);
+			break;
+	}
+	if (kind != 7)
+		put(7);
+}
+
+void Jit_compiler::op(uint16_t pc, const uint8_t *code, int live)
+{
+	uint8_t op {code[0]};
+	uint16_t imm {static_cast<uint16_t>(code[2] << 8 | code[1])};
+	uint16_t next {static_cast<uint16_t>(pc + op_codes[op].second)};
+	int cyc {op_cycles[op]};
+	int want {sets(op) & live};
+	Reg pairs[3] {bc_reg, de_reg, hl_reg};
+	int dst {(op >> 3) & 7}, src {op & 7};
+	++count_;
+	if (op >= 0x40 && op < 0x80)
+	{
+		// MOV
+		if (src == 6)
+		{
+			read(hl_reg);
+			put(dst);
+		}
+		else if (dst == 6)
+		{
+			get(src, rcx);
+			write(hl_reg, rcx);
+			cycles_ += cyc;
+			drop_check(next, 0);
+			return;
+		}
+		else
+		{
+			get(src, rax);
+			put(dst);
+		}
+		cycles_ += cyc;
+		return;
+	}
+	if (op >= 0x80 && op < 0xC0)
+	{
+		if (src == 6)
+		{
+			read(hl_reg);
+			a_.reg({0x89}, rax, rcx);
+		}
+		else
+			get(src, rcx);
+		alu(dst, live);
+		cycles_ += cyc;
+		return;
+	}
+	if (op >= 0xC0 && (op & 0x07) == 6)
+	{
+		a_.byte(0xB9); // mov ecx, imm
+		a_.imm32(code[1]);
+		alu(dst, live);
+		cycles_ += cyc;
+		return;
+	}
+	if (op < 0x40 && ((op & 0x07) == 4 || (op & 0x07) == 5))
+	{
+		// INR, DCR
+		bool inr {(op & 0x07) == 4};
+		if (dst == 6)
+			read(hl_reg);
+		else
+			get(dst, rax);
+		a_.bytes({0xFE, inr ? 0xC0 : 0xC8});
+		store_flags(want, inr ? Flag_kind::add : Flag_kind::sub);
+		cycles_ += cyc;
+		if (dst == 6)
+		{
+			write(hl_reg, rax);
+			drop_check(next, 0);
+		}
+		else
+			put(dst);
+		return;
+	}
+	switch (op)
+	{
+		case 0x00: case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+		case 0xCB: case 0xD9: case 0xDD: case 0xED: case 0xFD:
+			break;
+		case 0x01: case 0x11: case 0x21: // LXI
+			a_.rex(false, 0, pairs[op >> 4]);
+			a_.byte(0xB8 + (pairs[op >> 4] & 7));
+			a_.imm32(imm);
+			break;
+		case 0x31:
+			a_.mem({0xC7}, 0, cpu_reg, l_.sp, false, 0x66);
+			a_.imm16(imm);
+			break;
+		case 0x02: case 0x12: // STAX
+			get(7, rcx);
+			write(pairs[op >> 4], rcx);
+			cycles_ += cyc;
+			drop_check(next, 0);
+			return;
+		case 0x0A: case 0x1A: // LDAX
+			read(pairs[op >> 4]);
+			put(7);
+			break;
+		case 0x03: case 0x13: case 0x23: // INX
+			a_.reg({0xFF}, 0, pairs[op >> 4], false, 0x66);
+			break;
+		case 0x0B: case 0x1B: case 0x2B: // DCX
+			a_.reg({0xFF}, 1, pairs[op >> 4], false, 0x66);
+			break;
+		case 0x33:
+			a_.mem({0xFF}, 0, cpu_reg, l_.sp, false, 0x66);
+			break;
+		case 0x3B:
+			a_.mem({0xFF}, 1, cpu_reg, l_.sp, false, 0x66);
+			break;
+		case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // MVI
+			a_.byte(0xB8);
+			a_.imm32(code[1]);
+			put(dst);
+			break;
+		case 0x36:
+			a_.byte(0xB9);
+			a_.imm32(code[1]);
+			write(hl_reg, rcx);
+			cycles_ += cyc;
+			drop_check(next, 0);
+			return;
+		case 0x07: case 0x0F: case 0x17: case 0x1F: // RLC, RRC, RAL, RAR
+			if (op == 0x17 || op == 0x1F)
+				load_carry(rcx);
+			get(7, rax);
+			a_.bytes({0xD0, 0xC0 | (op >> 3) << 3});
+			store_carry(want);
+			put(7);
+			break;
+		case 0x09: case 0x19: case 0x29: case 0x39: // DAD
+			a_.reg({0x89}, hl_reg, rax);
+			if (op == 0x39)
+				a_.mem({0x03}, rax, cpu_reg, l_.sp, false, 0x66);
+			else
+				a_.reg({0x01}, pairs[op >> 4], rax, false, 0x66);
+			store_carry(want);
+			a_.reg({0x0F, 0xB7}, hl_reg, rax);
+			break;
+		case 0x22: // SHLD
+			get(5, rcx);
+			write(imm, rcx);
+			a_.mem({0x88}, rax, rsp, dropped_slot);
+			get(4, rcx);
+			write(static_cast<uint16_t>(imm + 1), rcx);
+			a_.mem({0x0A}, rax, rsp, dropped_slot);
+			cycles_ += cyc;
+			drop_check(next, 0);
+			return;
+		case 0x2A: // LHLD
+			read(imm);
+			a_.mem({0x88}, rax, rsp, scratch_slot);
+			read(static_cast<uint16_t>(imm + 1));
+			a_.reg({0x0F, 0xB6}, hl_reg, rax);
+			a_.reg({0xC1}, 4, hl_reg);
+			a_.byte(8);
+			a_.mem({0x0F, 0xB6}, rcx, rsp, scratch_slot);
+			a_.reg({0x09}, rcx, hl_reg);
+			break;
+		case 0x2F: // CMA: not r14b
+			a_.reg({0xF6}, 2, a_reg);
+			break;
+		case 0x32: // STA
+			get(7, rcx);
+			write(imm, rcx);
+			cycles_ += cyc;
+			drop_check(next, 0);
+			return;
+		case 0x3A: // LDA
+			read(imm);
+			put(7);
+			break;
+		case 0x37: // STC
+			a_.mem({0x80}, 1, cpu_reg, l_.psw); // or byte [psw], CY
+			a_.byte(fcy);
+			break;
+		case 0x3F: // CMC
+			a_.mem({0x80}, 6, cpu_reg, l_.psw); // xor byte [psw], CY
+			a_.byte(fcy);
+			break;
+		case 0xC1: case 0xD1: case 0xE1: // POP
+		{
+			Reg pair {pairs[(op >> 4) & 3]};
+			sp_adr(1);
+			read(rax);
+			a_.reg({0x89}, rax, pair);
+			a_.reg({0xC1}, 4, pair);
+			a_.byte(8);
+			sp_adr(0);
+			read(rax);
+			a_.reg({0x09}, rax, pair);
+			a_.mem({0x83}, 0, cpu_reg, l_.sp, false, 0x66);
+			a_.byte(2);
+			break;
+		}
+		case 0xF1: // POP PSW
+		{
+			sp_adr(0);
+			read(rax);
+			a_.bytes({0x24, psw_mask}); // and al, mask
+			a_.bytes({0x0C, psw_fixed}); // or al, fixed
+			a_.mem({0x88}, rax, cpu_reg, l_.psw);
+			sp_adr(1);
+			read(rax);
+			put(7);
+			a_.mem({0x83}, 0, cpu_reg, l_.sp, false, 0x66);
+			a_.byte(2);
+			break;
+		}
+		case 0xC5: case 0xD5: case 0xE5: case 0xF5: // PUSH
+		{
+			int hi {op == 0xF5 ? 7 : ((op >> 4) & 3) * 2};
+			sp_adr(-1);
+			get(hi, rcx);
+			write(rax, rcx);
+			a_.mem({0x88}, rax, rsp, dropped_slot);
+			sp_adr(-2);
+			if (op == 0xF5)
+				a_.mem({0x0F, 0xB6}, rcx, cpu_reg, l_.psw);
+			else
+				get(hi + 1, rcx);
+			write(rax, rcx);
+			a_.mem({0x0A}, rax, rsp, dropped_slot);
+			a_.mem({0x83}, 5, cpu_reg, l_.sp, false, 0x66); // sub word [sp], 2
+			a_.byte(2);
+			cycles_ += cyc;
+			drop_check(next, 0);
+			return;
+		}
+		case 0xEB: // XCHG
+			a_.reg({0x87}, de_reg, hl_reg);
+			break;
+		case 0xF9: // SPHL
+			a_.mem({0x89}, hl_reg, cpu_reg, l_.sp, false, 0x66);
+			break;
+		case 0xC3: // JMP
+			chain(imm, cyc);
+			return;
+		case 0xE9: // PCHL
+			a_.reg({0x89}, hl_reg, rcx);
+			chain_dynamic(cyc);
+			return;
+		case 0xC9: // RET
+			ret(cyc);
+			return;
+		case 0xCD: // CALL
+		case 0xC4: case 0xCC: case 0xD4: case 0xDC: case 0xE4: case 0xEC: case 0xF4: case 0xFC:
+		{
+			if (op != 0xCD)
+			{
+				uint8_t *taken {branch_if(op)};
+				chain(next, 11);
+				a_.bind(taken);
+			}
+			a_.mem({0x83}, 5, cpu_reg, l_.sp, false, 0x66);
+			a_.byte(2);
+			sp_adr(1);
+			a_.byte(0xB9);
+			a_.imm32(next >> 8);
+			write(rax, rcx);
+			a_.mem({0x88}, rax, rsp, dropped_slot);
+			sp_adr(0);
+			a_.byte(0xB9);
+			a_.imm32(next & 0xFF);
+			write(rax, rcx);
+			a_.mem({0x0A}, rax, rsp, dropped_slot);
+			drop_check(imm, 17);
+			chain(imm, 17);
+			return;
+		}
+		case 0xC2: case 0xCA: case 0xD2: case 0xDA: case 0xE2: case 0xEA: case 0xF2: case 0xFA: // Jcc
+		{
+			uint8_t *taken {branch_if(op)};
+			chain(next, cyc);
+			a_.bind(taken);
+			chain(imm, cyc);
+			return;
+		}
+		case 0xC0: case 0xC8: case 0xD0: case 0xD8: case 0xE0: case 0xE8: case 0xF0: case 0xF8: // Rcc
+		{
+			uint8_t *taken {branch_if(op)};
+			chain(next, 5);
+			a_.bind(taken);
+			ret(11);
+			return;
+		}
+	}
+	cycles_ += cyc;
+}
+
+void Jit_compiler::block(uint16_t pc, const uint8_t (*code)[3], int count)
+{
+	int n {0};
+	int max_cycles {0};
+	while (n < count && translatable(code[n][0]))
+		max_cycles += op_cycles[code[n++][0]];
+	// flags live after each instruction: all of them at the end of the
+	// block and wherever it may leave early
+	std::vector<int> live(n);
+	int after {all_flags};
+	for (int i {n - 1}; i >= 0; --i)
+	{
+		uint8_t op {code[i][0]};
+		if (i == n - 1 || writes(op))
+			after = all_flags;
+		live[i] = after;
+		after = uses(op) | (after & ~sets(op));
+	}
+	// lea rax, [rbp + max_cycles]; cmp rax, [rsp + deadline]; ja out
+	a_.mem({0x8D}, rax, cycles_reg, max_cycles, true);
+	a_.mem({0x3B}, rax, rsp, deadline_slot, true);
+	uint8_t *late {a_.jump({0x0F, 0x80 + cc_a})};
+	uint16_t at {pc};
+	for (int i {0}; i < n; ++i)
+	{
+		op(at, code[i], live[i]);
+		at += op_codes[code[i][0]].second;
+	}
+	if (falls_through(code[n - 1][0]))
+		chain(at, 0);
+	a_.bind(late);
+	a_.mem({0xC7}, 0, cpu_reg, l_.pc, false, 0x66);
+	a_.imm16(pc);
+	a_.byte(0xB8);
+	a_.imm32(static_cast<uint32_t>(Jit::Exit::deadline));
+	a_.jmp(jit_.exit_);
+}
+
+Jit::Jit(const Jit_layout &layout, Reader read, Writer write)
+	: layout_ {layout},
+	  read_ {read},
+	  write_ {write},
+	  entries_(0x10000, nullptr),
+	  failed_(0x10000, false)
+{
+	#ifdef I8080_JIT_X64
+		#ifdef _WIN32
+			void *p {VirtualAlloc(nullptr, arena_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE)};
+		#else
+			void *p {mmap(nullptr, arena_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+			if (p == MAP_FAILED)
+				p = nullptr;
+		#endif
+		if (p)
+		{
+			code_ = static_cast<uint8_t *>(p);
+			size_ = arena_size;
+			make_stubs();
+			if (!protect(false)) // no executable memory to be had after all
+				release();
+		}
+	#endif
+}
+
+Jit::~Jit()
+{
+	release();
+}
+
+bool Jit::ready() const
+{
+	return code_ != nullptr;
+}
+
+// The arena is never writable and executable at once: it is read-only code
+// while it runs, and writable only for as long as compile() takes.
+bool Jit::protect(bool writable)
+{
+	#ifdef I8080_JIT_X64
+		#ifdef _WIN32
+			DWORD old;
+			return VirtualProtect(code_, size_, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old);
+		#else
+			return mprotect(code_, size_, PROT_READ | (writable ? PROT_WRITE : PROT_EXEC)) == 0;
+		#endif
+	#else
+		static_cast<void>(writable);
+		return false;
+	#endif
+}
+
+void Jit::release()
+{
+	#ifdef I8080_JIT_X64
+		if (!code_)
+			return;
+		#ifdef _WIN32
+			VirtualFree(code_, 0, MEM_RELEASE);
+		#else
+			munmap(code_, size_);
+		#endif
+		code_ = nullptr;
+		size_ = 0;
+	#endif
+}
+
+// enter(cpu, entry, deadline) saves the host's registers, loads the 8080's
+// and jumps to entry; translated code leaves through exit with the reason in
+// eax, after storing the pc
+void Jit::make_stubs()
+{
+	Asm a {code_, code_ + size_};
+	#ifdef _WIN32
+		const Reg saved[] {rbx, rbp, rsi, rdi, r12, r13, r14, r15};
+	#else
+		const Reg saved[] {rbx, rbp, r12, r13, r14, r15};
+	#endif
+	const Jit_layout &l {layout_};
+	enter_ = a.here();
+	for (Reg r : saved)
+	{
+		a.rex(false, 0, r);
+		a.byte(0x50 + (r & 7));
+	}
+	a.reg({0x81}, 5, rsp, true); // sub rsp, frame
+	a.imm32(frame_size);
+	a.reg({0x89}, arg0, cpu_reg, true);
+	a.mem({0x89}, arg2, rsp, deadline_slot, true);
+	a.reg({0x89}, arg1, rax, true);
+	auto load_pair = [&](Reg pair, int hi, int lo)
+	{
+		a.mem({0x0F, 0xB6}, pair, cpu_reg, hi);
+		a.reg({0xC1}, 4, pair);
+		a.byte(8);
+		a.mem({0x0F, 0xB6}, rcx, cpu_reg, lo);
+		a.reg({0x09}, rcx, pair);
+	};
+	load_pair(hl_reg, l.h, l.l);
+	load_pair(bc_reg, l.b, l.c);
+	load_pair(de_reg, l.d, l.e);
+	a.mem({0x0F, 0xB6}, a_reg, cpu_reg, l.a);
+	a.mem({0x8B}, cycles_reg, cpu_reg, l.cycles, true);
+	a.bytes({0xFF, 0xE0}); // jmp rax
+
+	exit_ = a.here();
+	auto store_pair = [&](Reg pair, int hi, int lo)
+	{
+		a.reg({0x89}, pair, rcx);
+		a.mem({0x88}, rcx, cpu_reg, lo);
+		a.reg({0xC1}, 5, rcx);
+		a.byte(8);
+		a.mem({0x88}, rcx, cpu_reg, hi);
+	};
+	store_pair(hl_reg, l.h, l.l);
+	store_pair(bc_reg, l.b, l.c);
+	store_pair(de_reg, l.d, l.e);
+	a.reg({0x89}, a_reg, rcx);
+	a.mem({0x88}, rcx, cpu_reg, l.a);
+	a.mem({0x89}, cycles_reg, cpu_reg, l.cycles, true);
+	a.reg({0x81}, 0, rsp, true);
+	a.imm32(frame_size);
+	for (int i {static_cast<int>(sizeof saved / sizeof saved[0]) - 1}; i >= 0; --i)
+	{
+		a.rex(false, 0, saved[i]);
+		a.byte(0x58 + (saved[i] & 7));
+	}
+	a.byte(0xC3);
+	stubs_ = used_ = a.here() - code_;
+}
+
+const void *Jit::entry(uint16_t pc) const
+{
+	return entries_[pc];
+}
+
+bool Jit::failed(uint16_t pc) const
+{
+	return failed_[pc];
+}
+
+const void *Jit::compile(uint16_t pc, const uint8_t (*code)[3], int count)
+{
+	if (!code_ || count == 0 || !translatable(code[0][0]) || !protect(true))
+	{
+		failed_[pc] = true;
+		return nullptr;
+	}
+	const void *entry {nullptr};
+	for (int attempt {0}; attempt < 2 && !entry; ++attempt)
+	{
+		Asm a {code_ + used_, code_ + size_};
+		Jit_compiler c {*this, a};
+		c.block(pc, code, count);
+		if (!a.overflow())
+		{
+			entry = code_ + used_;
+			used_ = a.here() - code_;
+		}
+		else
+			clear(); // out of room: start over
+	}
+	if (!protect(false))
+	{
+		// can't run what was written: give up on translating altogether
+		clear();
+		release();
+		entry = nullptr;
+	}
+	entries_[pc] = entry;
+	failed_[pc] = !entry;
+	return entry;
+}
+
+Jit::Exit Jit::run(void *cpu, const void *entry, uint64_t deadline)
+{
+	using Enter = int (*)(void *cpu, const void *entry, uint64_t deadline);
+	Enter enter {reinterpret_cast<Enter>(const_cast<void *>(enter_))};
+	return static_cast<Exit>(enter(cpu, entry, deadline));
+}
+
+void Jit::drop(uint16_t pc)
+{
+	entries_[pc] = nullptr;
+	failed_[pc] = false;
+}
+
+void Jit::clear()
+{
+	std::fill(entries_.begin(), entries_.end(), nullptr);
+	std::fill(failed_.begin(), failed_.end(), false);
+	used_ = stubs_;
+}
+
+}
@@ -1,128 +1,384 @@
 #include "machine.hpp"
 
 #include <fstream>
-#include <bitset>
 
 namespace space_invaders
 {
-	
-Machine::Machine()
-	: cpu_
-	(
-		memory_,
-		[this](uint8_t o) { return this->in(o); },
-		[this](uint8_t p, uint8_t val) { this->out(p, val); }
-	),
-	window_ {SDL_CreateWindow("Space Invaders!", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-		SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_RESIZABLE)},
-	disp_ {SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, 0, 0, 0, 0)},
-	sounds_
+
+namespace
+{
+
+// save state layout, all little endian: magic, version, cpu registers and
+// flags, interrupt state, machine latches, frame count, whether the
+// mid-screen interrupt is still to come this frame, then ram
+constexpr uint32_t state_magic {0x54534953}; // "SIST"
+constexpr uint16_t state_version {2};
+constexpr uint16_t ram_start {0x2000};
+constexpr int ram_size {0x2000};
+
+void put(std::vector<uint8_t> &v, uint64_t x, int bytes)
+{
+	for (int i {0}; i < bytes; ++i)
+		v.push_back(x >> (8 * i));
+}
+
+class State_reader
+{
+	public:
+	explicit State_reader(const std::vector<uint8_t> &v) : v_ {v} {}
+
+	uint64_t get(int bytes)
 	{
-		Wav("audio/ufo_low"),
-		Wav("audio/shoot"),
-		Wav("audio/explosion"),
-		Wav("audio/invader_killed"),
-		Wav("audio/fleet1"),
-		Wav("audio/fleet2"),
-		Wav("audio/fleet3"),
-		Wav("audio/fleet4"),
-		Wav("audio/ufo_high")
+		if (pos_ + bytes > v_.size())
+		{
+			ok_ = false;
+			return 0;
+		}
+		uint64_t x {0};
+		for (int i {0}; i < bytes; ++i)
+			x |= static_cast<uint64_t>(v_[pos_++]) << (8 * i);
+		return x;
 	}
+
+	bool ok() const { return ok_; }
+	size_t left() const { return v_.size() - pos_; }
+	const uint8_t *here() const { return v_.data() + pos_; }
+
+	private:
+	const std::vector<uint8_t> &v_;
+	size_t pos_ {0};
+	bool ok_ {true};
+};
+
+// the flags as saved states keep them, z s p cy ac from bit 0 up
+constexpr uint8_t saved_flags[5] {i8080::z_flag, i8080::s_flag, i8080::p_flag, i8080::cy_flag, i8080::ac_flag};
+
+uint8_t pack(uint8_t psw)
+{
+	uint8_t x {0};
+	for (int i {0}; i < 5; ++i)
+		x |= bool(psw & saved_flags[i]) << i;
+	return x;
+}
+
+uint8_t unpack(uint8_t x)
+{
+	uint8_t psw {i8080::psw_fixed};
+	for (int i {0}; i < 5; ++i)
+		psw |= x >> i & 1 ? saved_flags[i] : 0;
+	return psw;
+}
+
+}
+
+Machine::Machine(i8080::Dispatch d)
+	: cpu_ {i8080::Paged_bus {}, Machine_ports {this}, d},
+	  memory_ {new uint8_t[image_pages * page_size]()}
+{
+	local_.set();
+	for (int q {0}; q < image_pages; ++q)
+		remap(q);
+	dirty_.set();
+	schedule_frame();
+}
+
+// the child's own memory is left uninitialized: every page starts out shared
+Machine::Machine(const Machine &parent, Fork_tag)
+	: cpu_ {i8080::Paged_bus {}, Machine_ports {this}, parent.cpu_.dispatch()},
+	  memory_ {new uint8_t[image_pages * page_size]},
+	  shared_ {parent.shared_},
+	  shift0 {parent.shift0},
+	  shift1 {parent.shift1},
+	  shift_offset {parent.shift_offset},
+	  inp1_ {parent.inp1_},
+	  inp2_ {parent.inp2_},
+	  sound1_ {parent.sound1_}, last_sound1_ {parent.last_sound1_},
+	  sound2_ {parent.sound2_}, last_sound2_ {parent.last_sound2_},
+	  frames_ {parent.frames_},
+	  events_ {parent.events_} // forked mid-frame, the child goes on from the same point
+{
+	cpu_.set_state(parent.cpu_.state());
+	for (int q {0}; q < image_pages; ++q)
+		remap(q);
+	dirty_.set();
+	schedule_audio(); // sinks aren't carried over, nor their ticks
+}
+
+// Forking freezes the pages the parent changed since its last fork into
+// shared copies; from then on parent and children alike copy a shared page
+// into their own memory on its first write. Forking a machine that didn't
+// write since its last fork copies nothing, and pages nobody writes to (the
+// rom, most of video ram) stay shared for good.
+std::unique_ptr<Machine> Machine::fork()
 {
-	if (!window_)
+	for (int q {0}; q < image_pages; ++q)
+		share(q);
+	return std::unique_ptr<Machine> {new Machine {*this, Fork_tag {}}};
+}
+
+const uint8_t *Machine::page(int q) const
+{
+	return local_[q] ? &memory_[q * page_size] : shared_[q]->data();
+}
+
+// Points the bus at page q of the image. The address bus decodes 15 bits, so
+// the top half mirrors the bottom one: rom at 0x0000-0x1FFF, ram at
+// 0x2000-0x3FFF (video ram from 0x2400), the unused rom sockets at
+// 0x4000-0x5FFF and a mirror of the ram at 0x6000-0x7FFF. Rom ignores
+// writes; ram writes go through write_ram while the page is shared, and
+// always for video ram, to track dirty columns.
+void Machine::remap(int q)
+{
+	constexpr int ram_first {0x2000 / page_size}, ram_end {0x4000 / page_size};
+	bool ram {q >= ram_first && q < ram_end};
+	bool direct {ram && local_[q] && !shared_[q] && q < vram_start / page_size};
+	i8080::Paged_bus &bus {cpu_.bus()};
+	for (int mirror : {0x00, 0x40, 0x80, 0xC0})
 	{
-		std::cerr << "Could not create SDL_Window!\n";
-		throw;
+		if (mirror % 0x80 && !ram)
+			continue;
+		int p {q + mirror};
+		if (direct)
+			bus.map(p, 1, &memory_[q * page_size]);
+		else
+			bus.map(p, 1, page(q));
+		if (ram && !direct)
+			bus.hook_write(p, write_ram, this);
 	}
-	if (!disp_)
+}
+
+// freezes page q into a copy forks can share
+void Machine::share(int q)
+{
+	if (shared_[q])
+		return;
+	auto copy {std::make_shared<Page>()};
+	std::copy_n(&memory_[q * page_size], page_size, copy->begin());
+	shared_[q] = copy;
+	remap(q);
+}
+
+// brings page q into this machine's own memory, keeping it shared
+void Machine::localize(int q)
+{
+	if (local_[q])
+		return;
+	std::copy(shared_[q]->begin(), shared_[q]->end(), &memory_[q * page_size]);
+	local_[q] = true;
+	remap(q);
+}
+
+// makes page q private to this machine, ready to be written
+void Machine::own(int q)
+{
+	localize(q);
+	shared_[q].reset();
+	remap(q);
+}
+
+void Machine::write_ram(void *m, uint16_t adr, uint8_t val)
+{
+	Machine &self {*static_cast<Machine *>(m)};
+	adr &= 0x3FFF;
+	int q {adr / page_size};
+	if (self.shared_[q])
+		self.own(q);
+	self.memory_[adr] = val;
+	if (adr >= vram_start)
+		self.dirty_[(adr - vram_start) / (SCREEN_HEIGHT / 8)] = true;
+}
+
+void Machine::attach_video(Video_sink *v)
+{
+	video_ = v;
+}
+
+void Machine::attach_audio(Audio_sink *a)
+{
+	audio_ = a;
+	schedule_audio();
+}
+
+Machine_cpu &Machine::cpu()
+{
+	return cpu_;
+}
+
+// the sinks need video ram in one piece, so pages still shared with a fork
+// get copied into this machine's memory first
+const uint8_t *Machine::vram()
+{
+	for (int q {vram_start / page_size}; q < 0x4000 / page_size; ++q)
+		localize(q);
+	return &memory_[vram_start];
+}
+
+uint64_t Machine::frames() const
+{
+	return frames_;
+}
+
+// runs exactly one 60 Hz frame, with no wall clock involved: the cpu runs up
+// to each event in turn, the mid-screen interrupt (RST 1) halfway through
+// and the end-of-screen one (RST 2) at the end
+void Machine::step_frame()
+{
+	uint64_t frame {frames_};
+	while (frames_ == frame)
 	{
-		std::cerr << "Could not create SDL_Surface!\n";
-		throw;
+		cpu_.run_until(events_.next());
+		handle_events();
 	}
 }
 
-void Machine::execute_cpu(long cyc)
+// Where half frame number half ends on the cycle counter, counting from 1.
+// Events are stamped with absolute cycles, so the cycles an instruction runs
+// past one come off the next and frames stay exact on average.
+uint64_t Machine::half_frame_end(uint64_t half)
 {
-	long cyc_ran {0};
-	long cyc_start {0};
-	long cyc_finish {0};
-	while (cyc_ran < cyc)
+	constexpr uint64_t half_frames_per_s {120};
+	return half * cpu_clock / half_frames_per_s;
+}
+
+void Machine::schedule_frame()
+{
+	events_.schedule(Event::mid_screen, half_frame_end(2 * frames_ + 1));
+	events_.schedule(Event::end_screen, half_frame_end(2 * frames_ + 2));
+}
+
+// ticks are spread evenly over the cycles, starting after the current one
+void Machine::schedule_audio()
+{
+	unsigned rate {audio_ ? audio_->tick_rate() : 0};
+	if (!rate)
 	{
-		cyc_start = cpu_.cycles();
-		cpu_.emulate_op();
-		cyc_finish = cpu_.cycles();
-		cyc_ran += (cyc_finish - cyc_start);
+		events_.cancel(Event::audio_tick);
+		return;
 	}
+	audio_ticks_ = cpu_.cycles() * rate / cpu_clock + 1;
+	events_.schedule(Event::audio_tick, audio_ticks_ * cpu_clock / rate);
 }
 
-void Machine::run()
+uint64_t Machine::next_event() const
 {
-	SDL_Event e;
-	uint32_t last_tic = SDL_GetTicks();
-	constexpr double tic = 1000.0 / 60.0; // ms per tic
-	constexpr int cycles_per_ms = 2000; // 2 Mhz
-	constexpr double cycles_per_tic = cycles_per_ms * tic;
-	while (!done_)
+	return events_.next();
+}
+
+// handles every event due by the current cycle, earliest first
+void Machine::handle_events()
+{
+	Event e;
+	while (events_.pop(cpu_.cycles(), e))
 	{
-		if ((SDL_GetTicks() - last_tic) >= tic)
+		switch (e)
 		{
-			last_tic = SDL_GetTicks();
-			execute_cpu(cycles_per_tic / 2);
-			cpu_.interrupt(0xCF);
-			execute_cpu(cycles_per_tic / 2);
-			while (SDL_PollEvent(&e))
+			case Event::mid_screen:
+				cpu_.interrupt(0xCF);
+				break;
+			case Event::end_screen:
+				if (video_)
+					video_->draw(vram(), dirty_columns());
+				cpu_.interrupt(0xD7);
+				++frames_;
+				schedule_frame();
+				break;
+			case Event::audio_tick:
 			{
-				if (e.type == SDL_QUIT)
-					done_ = true;
-				else if (e.type == SDL_KEYDOWN)
-				{
-					switch (e.key.keysym.sym)
-					{
-						case SDLK_t:
-							cpu_.debug_info();
-							break;
-						default:
-							key_down(e.key.keysym.sym);
-					}
-				}
-				else if (e.type == SDL_KEYUP)
-				{
-					switch (e.key.keysym.sym)
-					{
-						default:
-							key_up(e.key.keysym.sym);
-					}
-				}
+				unsigned rate {audio_->tick_rate()};
+				audio_->tick();
+				++audio_ticks_;
+				events_.schedule(Event::audio_tick, audio_ticks_ * cpu_clock / rate);
 			}
-			update_screen();
-			cpu_.interrupt(0xD7);
+			break;
+			case Event::count:
+				break;
 		}
 	}
 }
 
-void Machine::update_screen()
+// collects the video ram columns the cpu wrote to and starts tracking afresh
+Column_mask Machine::dirty_columns()
 {
-	uint32_t *pix {(uint32_t *) disp_->pixels};
-	int i {0x2400}; // start of video ram
-	for (int col {0}; col < SCREEN_WIDTH; ++col)
-	{
-		for (int row {SCREEN_HEIGHT}; row > 0; row -= 8)
-		{
-			for (int j {0}; j < 8; ++j)
-			{	
-				int idx = (row - j) * SCREEN_WIDTH + col;
-				if (memory_[i] & 1 << j)
-					pix[idx] = 0xFFFFFF;
-				else
-					pix[idx] = 0x000000;
-			}
-			++i;
-		}
-	}
-	SDL_Surface *winsurf = SDL_GetWindowSurface(window_);
-	SDL_BlitScaled(disp_, NULL, winsurf, NULL);
-	if (SDL_UpdateWindowSurface(window_))
-		std::cerr << SDL_GetError();
+	Column_mask columns {dirty_};
+	dirty_.reset();
+	return columns;
+}
+
+std::vector<uint8_t> Machine::save_state() const
+{
+	std::vector<uint8_t> v;
+	save_state(v);
+	return v;
+}
+
+void Machine::save_state(std::vector<uint8_t> &v) const
+{
+	v.clear();
+	v.reserve(64 + ram_size);
+	put(v, state_magic, 4);
+	put(v, state_version, 2);
+	i8080::Cpu_state c {cpu_.state()};
+	for (uint8_t r : {c.b, c.c, c.d, c.e, c.h, c.l, c.a})
+		put(v, r, 1);
+	put(v, c.sp, 2);
+	put(v, c.pc, 2);
+	put(v, pack(c.psw), 1);
+	put(v, c.cycles, 8);
+	for (uint8_t x : {uint8_t {c.int_enabled}, uint8_t {c.int_pending}, c.int_op, uint8_t {c.halted}})
+		put(v, x, 1);
+	for (uint8_t x : {shift0, shift1, shift_offset, inp1_, inp2_, sound1_, last_sound1_, sound2_, last_sound2_})
+		put(v, x, 1);
+	put(v, frames_, 8);
+	put(v, events_.due(Event::mid_screen) != Scheduler::never, 1);
+	for (int q {ram_start / page_size}; q < (ram_start + ram_size) / page_size; ++q)
+		v.insert(v.end(), page(q), page(q) + page_size);
+}
+
+// leaves the machine untouched and returns false if the state is malformed
+// or from another version
+bool Machine::load_state(const std::vector<uint8_t> &state)
+{
+	State_reader r {state};
+	if (r.get(4) != state_magic || r.get(2) != state_version)
+		return false;
+	i8080::Cpu_state c;
+	for (uint8_t *reg : {&c.b, &c.c, &c.d, &c.e, &c.h, &c.l, &c.a})
+		*reg = r.get(1);
+	c.sp = r.get(2);
+	c.pc = r.get(2);
+	c.psw = unpack(r.get(1));
+	c.cycles = r.get(8);
+	c.int_enabled = r.get(1);
+	c.int_pending = r.get(1);
+	c.int_op = r.get(1);
+	c.halted = r.get(1);
+	uint8_t latches[9];
+	for (uint8_t &x : latches)
+		x = r.get(1);
+	uint64_t frames {r.get(8)};
+	bool mid_screen_due {r.get(1) != 0};
+	if (!r.ok() || r.left() != ram_size)
+		return false;
+
+	cpu_.set_state(c);
+	bool ufo {bool(last_sound1_ & 0x1)};
+	uint8_t *const dst[9] {&shift0, &shift1, &shift_offset, &inp1_, &inp2_,
+		&sound1_, &last_sound1_, &sound2_, &last_sound2_};
+	for (int i {0}; i < 9; ++i)
+		*dst[i] = latches[i];
+	if (ufo != bool(last_sound1_ & 0x1)) // the sink still hears the ufo as it was
+		sound_level(Sound::ufo, !ufo);
+	frames_ = frames;
+	for (int q {ram_start / page_size}; q < (ram_start + ram_size) / page_size; ++q)
+		own(q);
+	std::copy(r.here(), r.here() + ram_size, &memory_[ram_start]);
+	cpu_.invalidate_blocks();
+	dirty_.set();
+	schedule_frame();
+	if (!mid_screen_due) // saved after RST 1, which mustn't come twice
+		events_.cancel(Event::mid_screen);
+	schedule_audio();
+	return true;
 }
 
 bool Machine::load_program(const std::string &in, uint16_t off)
@@ -130,18 +386,25 @@ bool Machine::load_program(const std::string &in, uint16_t off)
 	std::ifstream f {in, std::ios::binary};
 	if (!f.good())
 		return false;
-	std::copy
-	(
+	std::vector<char> program
+	{
 		std::istreambuf_iterator<char>(f),
-		std::istreambuf_iterator<char>(),
-		memory_.begin() + off
-	);
+		std::istreambuf_iterator<char>()
+	};
+	if (off + program.size() > image_pages * page_size)
+		return false;
+	int end {off + static_cast<int>(program.size())};
+	for (int q {off / page_size}; q * page_size < end; ++q)
+		own(q);
+	std::copy(program.begin(), program.end(), &memory_[off]);
+	cpu_.invalidate_blocks();
+	dirty_.set();
 	return true;
 }
 
 uint8_t Machine::in(uint8_t port)
 {
-	uint8_t a;
+	uint8_t a {0};
 	switch (port)
 	{
 		case 1:
@@ -160,30 +423,49 @@ uint8_t Machine::in(uint8_t port)
 	return a;
 }
 
+// sounds are stamped with the cycle of the OUT that set them off
+void Machine::emit(Sound s)
+{
+	if (audio_)
+		audio_->play(s, cpu_.cycles());
+}
+
+void Machine::sound_level(Sound s, bool on)
+{
+	if (!audio_)
+		return;
+	if (on)
+		audio_->play(s, cpu_.cycles());
+	else
+		audio_->stop(s, cpu_.cycles());
+}
+
 void Machine::play_sound()
 {
 	if (sound1_ != last_sound1_) // bit changed
 	{
+		if ((sound1_ ^ last_sound1_) & 0x1) // the ufo sounds for as long as its bit is set
+			sound_level(Sound::ufo, sound1_ & 0x1);
 		if ( (sound1_ & 0x2) && !(last_sound1_ & 0x2) )
-			sounds_[1].play();
+			emit(Sound::shot);
         if ( (sound1_ & 0x4) && !(last_sound1_ & 0x4) )
-            sounds_[2].play();
+            emit(Sound::player_die);
         if ( (sound1_ & 0x8) && !(last_sound1_ & 0x8) )
-			sounds_[3].play();
+			emit(Sound::invader_die);
 		last_sound1_ = sound1_;
 	}
 	if (sound2_ != last_sound2_)
 	{
 		if ( (sound2_ & 0x1) && !(last_sound2_ & 0x1) )
-			sounds_[4].play();
+			emit(Sound::fleet1);
 		if ( (sound2_ & 0x2) && !(last_sound2_ & 0x2) )
-			sounds_[5].play();
+			emit(Sound::fleet2);
 		if ( (sound2_ & 0x4) && !(last_sound2_ & 0x4) )
-			sounds_[6].play();
+			emit(Sound::fleet3);
 		if ( (sound2_ & 0x8) && !(last_sound2_ & 0x8) )
-			sounds_[7].play();
+			emit(Sound::fleet4);
 		if ( (sound2_ & 0x10) && !(last_sound2_ & 0x10) )
-			sounds_[8].play();
+			emit(Sound::ufo_hit);
 		last_sound2_ = sound2_;
 	}
 }
@@ -210,72 +492,95 @@ void Machine::out(uint8_t port, uint8_t val)
 	play_sound();
 }
 
-void Machine::key_down(SDL_Keycode k)
+void Machine::press(Button b)
 {
-	switch (k)
+	switch (b)
 	{
-		case SDLK_c: // insert coin
+		case Button::coin:
 			inp1_ |= 1;
 			break;
-		case SDLK_s: // P1 Start
+		case Button::p1_start:
 			inp1_ |= 1 << 2;
 			break;
-		case SDLK_w: // P1 Shoot
+		case Button::p1_shoot:
 			inp1_ |= 1 << 4;
 			break;
-		case SDLK_a: // P1 left
+		case Button::p1_left:
 			inp1_ |= 1 << 5;
 			break;
-		case SDLK_d: // P1 right
+		case Button::p1_right:
 			inp1_ |= 1 << 6;
 			break;
-		case SDLK_LEFT: // P2 left
+		case Button::p2_left:
 			inp2_ |= 1 << 5; 
 			break;
-		case SDLK_RIGHT: // P2 right
+		case Button::p2_right:
 			inp2_ |= 1 << 6;
 			break;
-		case SDLK_RETURN: // P2 start
+		case Button::p2_start:
 			inp1_ |= 1 << 1;
 			break;
-		case SDLK_UP: // P2 shoot
+		case Button::p2_shoot:
 			inp2_ |= 1 << 4;
 			break;
 	}
 }
 
-void Machine::key_up(SDL_Keycode k)
+void Machine::release(Button b)
 {
-	switch (k)
+	switch (b)
 	{
-		case SDLK_c: // insert coin
+		case Button::coin:
 			inp1_ &= ~1;
 			break;
-		case SDLK_s: // P1 Start
+		case Button::p1_start:
 			inp1_ &= ~(1 << 2);
 			break;
-		case SDLK_w: // P1 Shoot
+		case Button::p1_shoot:
 			inp1_ &= ~(1 << 4);
 			break;
-		case SDLK_a: // P1 left
+		case Button::p1_left:
 			inp1_ &= ~(1 << 5);
 			break;
-		case SDLK_d: // P1 right
+		case Button::p1_right:
 			inp1_ &= ~(1 << 6);
 			break;
-		case SDLK_LEFT: // P2 left
+		case Button::p2_left:
 			inp2_ &= ~(1 << 5); 
 			break;
-		case SDLK_RIGHT: // P2 right
+		case Button::p2_right:
 			inp2_ &= ~(1 << 6);
 			break;
-		case SDLK_RETURN: // P2 start
+		case Button::p2_start:
 			inp1_ &= ~(1 << 1);
 			break;
-		case SDLK_UP: // P2 shoot
+		case Button::p2_shoot:
 			inp2_ &= ~(1 << 4);
 			break;
 	}
 }
 
-}
\ No newline at end of file
+Inputs Machine::inputs() const
+{
+	return {inp1_, inp2_};
+}
+
+void Machine::set_inputs(Inputs in)
+{
+	inp1_ = in.port1;
+	inp2_ = in.port2;
+}
+
+uint8_t Machine_ports::in(uint8_t port)
+{
+	return m->in(port);
+}
+
+void Machine_ports::out(uint8_t port, uint8_t val)
+{
+	m->out(port, val);
+}
+
+}
+
+template class i8080::Cpu<i8080::Paged_bus, space_invaders::Machine_ports>;
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "machine_batch.hpp"
+
+namespace space_invaders
+{
+
+namespace
+{
+
+std::vector<Machine_cpu *> cpus_of(const std::vector<Machine *> &machines)
+{
+	std::vector<Machine_cpu *> cpus;
+	for (Machine *m : machines)
+		cpus.push_back(&m->cpu());
+	return cpus;
+}
+
+}
+
+Machine_batch::Machine_batch(std::vector<Machine *> machines)
+	: machines_ {std::move(machines)},
+	  cpus_ {cpus_of(machines_)},
+	  deadlines_(machines_.size()),
+	  frames_(machines_.size())
+{
+}
+
+// Runs every cabinet to its next event at once, and again until each has
+// finished its frame; the ones that have sit out the rest with a deadline
+// they already reached.
+void Machine_batch::step_frame()
+{
+	for (size_t i {0}; i < machines_.size(); ++i)
+		frames_[i] = machines_[i]->frames();
+	bool running {true};
+	while (running)
+	{
+		for (size_t i {0}; i < machines_.size(); ++i)
+		{
+			Machine &m {*machines_[i]};
+			deadlines_[i] = m.frames() == frames_[i] ? m.next_event() : m.cpu().cycles();
+		}
+		cpus_.run_until(deadlines_);
+		running = false;
+		for (size_t i {0}; i < machines_.size(); ++i)
+		{
+			Machine &m {*machines_[i]};
+			if (m.frames() != frames_[i])
+				continue;
+			m.handle_events();
+			running |= m.frames() == frames_[i];
+		}
+	}
+}
+
+const i8080::Cpu_batch<i8080::Paged_bus, Machine_ports> &Machine_batch::cpus() const
+{
+	return cpus_;
+}
+
+}
@@ -0,0 +1,154 @@
+#include "machine_farm.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace space_invaders
+{
+
+Machine_farm::Machine_farm(size_t cabinets, unsigned threads, i8080::Dispatch d)
+	: observations_(cabinets),
+	  queues_(std::max(threads, 1u))
+{
+	for (size_t i {0}; i < cabinets; ++i)
+		machines_.push_back(std::make_unique<Machine>(d));
+	for (unsigned w {1}; w < queues_.size(); ++w)
+		workers_.emplace_back(&Machine_farm::work, this, w);
+}
+
+Machine_farm::~Machine_farm()
+{
+	{
+		std::lock_guard<std::mutex> hold {lock_};
+		stopping_ = true;
+	}
+	start_.notify_all();
+	for (std::thread &t : workers_)
+		t.join();
+}
+
+bool Machine_farm::load_program(const std::string &in)
+{
+	if (machines_.empty())
+		return true;
+	if (!machines_[0]->load_program(in))
+		return false;
+	// the rest start as forks of the first, so they all share its rom pages
+	for (size_t i {1}; i < machines_.size(); ++i)
+		machines_[i] = machines_[0]->fork();
+	return true;
+}
+
+size_t Machine_farm::size() const
+{
+	return machines_.size();
+}
+
+unsigned Machine_farm::threads() const
+{
+	return queues_.size();
+}
+
+Machine &Machine_farm::machine(size_t i)
+{
+	return *machines_[i];
+}
+
+const Observation *Machine_farm::step_frame()
+{
+	size_t chunks {(machines_.size() + chunk_size - 1) / chunk_size};
+	if (chunks == 0)
+		return observations_.data();
+	{
+		std::lock_guard<std::mutex> hold {lock_};
+		pending_ = chunks;
+		++generation_;
+	}
+	// each worker starts on a run of neighbouring chunks
+	for (size_t c {0}; c < chunks; ++c)
+	{
+		Queue &q {queues_[c * queues_.size() / chunks]};
+		std::lock_guard<std::mutex> hold {q.lock};
+		q.chunks.push_back(c);
+	}
+	start_.notify_all();
+	run_chunks(0);
+	std::unique_lock<std::mutex> hold {lock_};
+	done_.wait(hold, [this] { return pending_ == 0; });
+	return observations_.data();
+}
+
+const Observation *Machine_farm::observations() const
+{
+	return observations_.data();
+}
+
+void Machine_farm::work(unsigned w)
+{
+	uint64_t seen {0};
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> hold {lock_};
+			start_.wait(hold, [&] { return stopping_ || generation_ != seen; });
+			if (stopping_)
+				return;
+			seen = generation_;
+		}
+		run_chunks(w);
+	}
+}
+
+void Machine_farm::run_chunks(unsigned w)
+{
+	size_t chunk;
+	while (take(w, chunk))
+	{
+		run_chunk(chunk);
+		std::lock_guard<std::mutex> hold {lock_};
+		if (--pending_ == 0)
+			done_.notify_one();
+	}
+}
+
+// the front of worker w's own queue, or else the back of another's
+bool Machine_farm::take(unsigned w, size_t &chunk)
+{
+	for (size_t k {0}; k < queues_.size(); ++k)
+	{
+		Queue &q {queues_[(w + k) % queues_.size()]};
+		std::lock_guard<std::mutex> hold {q.lock};
+		if (q.chunks.empty())
+			continue;
+		if (k == 0)
+		{
+			chunk = q.chunks.front();
+			q.chunks.pop_front();
+		}
+		else
+		{
+			chunk = q.chunks.back();
+			q.chunks.pop_back();
+		}
+		return true;
+	}
+	return false;
+}
+
+void Machine_farm::run_chunk(size_t chunk)
+{
+	size_t end {std::min((chunk + 1) * chunk_size, machines_.size())};
+	for (size_t i {chunk * chunk_size}; i < end; ++i)
+	{
+		Machine &m {*machines_[i]};
+		m.step_frame();
+		Observation &o {observations_[i]};
+		std::memcpy(o.vram, m.vram(), vram_size);
+		i8080::Paged_bus &bus {m.cpu().bus()};
+		o.score[0] = bus.read(p1_score_adr);
+		o.score[1] = bus.read(p1_score_adr + 1);
+		o.lives = bus.read(p1_ships_adr);
+	}
+}
+
+}
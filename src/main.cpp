@@ -2,8 +2,8 @@
 #include <fstream>
 #include <string>
 
-#include "cpu.hpp"
 #include "machine.hpp"
+#include "frontend.hpp"
 
 int main(int argc, char *argv[])
 {
@@ -12,12 +12,38 @@ int main(int argc, char *argv[])
 		fprintf(stderr, "SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
 		throw;
 	}
-	std::string game;
-	std::cout << "Enter the path of a ROM to load.\n";
-	std::cin >> game;
-	space_invaders::Machine cabinet {};
-	cabinet.load_program(game, 0x00);
-	cabinet.run();
+	// usage: emulator [--turbo] [--jit] [--record movie] [rom]
+	std::string game, record;
+	bool turbo {false};
+	i8080::Dispatch dispatch {i8080::default_dispatch};
+	for (int i {1}; i < argc; ++i)
+	{
+		std::string arg {argv[i]};
+		if (arg == "--turbo")
+			turbo = true;
+		else if (arg == "--jit")
+			dispatch = i8080::Dispatch::jit;
+		else if (arg == "--record" && i + 1 < argc)
+			record = argv[++i];
+		else
+			game = arg;
+	}
+	if (game.empty())
+	{
+		std::cout << "Enter the path of a ROM to load.\n";
+		std::cin >> game;
+	}
+	{
+		space_invaders::Machine cabinet {dispatch};
+		space_invaders::Frontend frontend {turbo};
+		cabinet.attach_video(&frontend);
+		cabinet.attach_audio(&frontend);
+		cabinet.load_program(game, 0x00);
+		space_invaders::Movie movie {};
+		frontend.run(cabinet, record.empty() ? nullptr : &movie);
+		if (!record.empty() && !movie.save(record))
+			std::cerr << "Could not save movie " << record << '\n';
+	}
 	SDL_Quit();
 	return 0;
 }
\ No newline at end of file
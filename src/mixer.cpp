@@ -0,0 +1,302 @@
+#include "mixer.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace space_invaders
+{
+
+namespace
+{
+
+// in the order of Sound
+constexpr const char *sound_names[sound_count]
+{
+	"ufo_low", "shoot", "explosion", "invader_killed",
+	"fleet1", "fleet2", "fleet3", "fleet4", "ufo_high"
+};
+
+uint32_t get(const std::vector<uint8_t> &v, size_t pos, int bytes)
+{
+	uint32_t x {0};
+	for (int i {0}; i < bytes; ++i)
+		x |= static_cast<uint32_t>(v[pos + i]) << (8 * i);
+	return x;
+}
+
+struct Pcm
+{
+	int rate {0};
+	int channels {0};
+	int bits {0};
+	const uint8_t *data {nullptr};
+	size_t frames {0};
+};
+
+// finds the format and the samples among the chunks of a RIFF WAVE file
+bool parse_wav(const std::vector<uint8_t> &v, Pcm &pcm)
+{
+	if (v.size() < 12 || get(v, 0, 4) != 0x46464952 || get(v, 8, 4) != 0x45564157) // "RIFF", "WAVE"
+		return false;
+	bool format {false};
+	for (size_t pos {12}; pos + 8 <= v.size();)
+	{
+		uint32_t id {get(v, pos, 4)};
+		size_t size {get(v, pos + 4, 4)};
+		pos += 8;
+		if (size > v.size() - pos)
+			return false;
+		if (id == 0x20746D66 && size >= 16) // "fmt "
+		{
+			if (get(v, pos, 2) != 1) // PCM
+				return false;
+			pcm.channels = get(v, pos + 2, 2);
+			pcm.rate = get(v, pos + 4, 4);
+			pcm.bits = get(v, pos + 14, 2);
+			format = true;
+		}
+		else if (id == 0x61746164 && format) // "data"
+		{
+			if (pcm.channels < 1 || pcm.rate < 1 || (pcm.bits != 8 && pcm.bits != 16))
+				return false;
+			pcm.data = &v[pos];
+			pcm.frames = size / (pcm.channels * pcm.bits / 8);
+			return true;
+		}
+		pos += size + (size & 1); // chunks are padded to even sizes
+	}
+	return false;
+}
+
+// frame i, mixed down to mono
+int16_t sample(const Pcm &pcm, size_t i)
+{
+	int32_t sum {0};
+	for (int c {0}; c < pcm.channels; ++c)
+	{
+		size_t k {i * pcm.channels + c};
+		if (pcm.bits == 8)
+			sum += (pcm.data[k] - 128) * 256; // 8-bit samples are unsigned
+		else
+			sum += static_cast<int16_t>(pcm.data[2 * k] | pcm.data[2 * k + 1] << 8);
+	}
+	return sum / pcm.channels;
+}
+
+}
+
+Mixer::Mixer(int rate)
+	: rate_ {rate}
+{
+}
+
+bool Mixer::load_sounds(const std::string &dir)
+{
+	bool ok {true};
+	for (int i {0}; i < sound_count; ++i)
+		ok &= load(static_cast<Sound>(i), dir + '/' + sound_names[i] + ".wav");
+	set_loop(Sound::ufo, true);
+	return ok;
+}
+
+// converts the file to the mixer's rate as it goes into the pool, with
+// linear interpolation between its samples; a sound loaded again gives up
+// its old samples, and the clips after them move down
+bool Mixer::load(Sound s, const std::string &path)
+{
+	std::ifstream f {path, std::ios::binary};
+	if (!f.good())
+		return false;
+	std::vector<uint8_t> file
+	{
+		std::istreambuf_iterator<char>(f),
+		std::istreambuf_iterator<char>()
+	};
+	Pcm pcm;
+	if (!parse_wav(file, pcm) || !pcm.frames)
+		return false;
+	Clip &clip {clips_[static_cast<int>(s)]};
+	pool_.erase(pool_.begin() + clip.start, pool_.begin() + clip.start + clip.length);
+	for (Clip &other : clips_)
+		if (other.start > clip.start)
+			other.start -= clip.length;
+	clip.start = pool_.size();
+	clip.length = pcm.frames * rate_ / pcm.rate;
+	uint64_t step {(static_cast<uint64_t>(pcm.rate) << 16) / rate_}; // 16.16 fixed point
+	uint64_t at {0};
+	for (size_t i {0}; i < clip.length; ++i, at += step)
+	{
+		size_t k {std::min<size_t>(at >> 16, pcm.frames - 1)};
+		int32_t a {sample(pcm, k)};
+		int32_t b {sample(pcm, std::min(k + 1, pcm.frames - 1))};
+		pool_.push_back(a + ((b - a) * static_cast<int64_t>(at & 0xFFFF) >> 16));
+	}
+	voices_[static_cast<int>(s)] = Voice {};
+	return true;
+}
+
+int Mixer::rate() const
+{
+	return rate_;
+}
+
+void Mixer::set_loop(Sound s, bool loop)
+{
+	clips_[static_cast<int>(s)].loop = loop;
+}
+
+void Mixer::play(Sound s)
+{
+	Voice &v {voices_[static_cast<int>(s)]};
+	v.pos = 0;
+	v.playing = clips_[static_cast<int>(s)].length > 0;
+}
+
+void Mixer::stop(Sound s)
+{
+	voices_[static_cast<int>(s)].playing = false;
+}
+
+// adds up the playing voices a chunk at a time, then clips the sum to 16 bits
+void Mixer::mix(int16_t *out, size_t n)
+{
+	while (n)
+	{
+		size_t chunk {std::min(n, sum_.size())};
+		std::fill_n(sum_.begin(), chunk, 0);
+		for (int i {0}; i < sound_count; ++i)
+		{
+			Voice &v {voices_[i]};
+			if (!v.playing)
+				continue;
+			const Clip &clip {clips_[i]};
+			for (size_t done {0}; v.playing && done < chunk;)
+			{
+				size_t count {std::min(chunk - done, clip.length - v.pos)};
+				const int16_t *src {&pool_[clip.start + v.pos]};
+				for (size_t k {0}; k < count; ++k)
+					sum_[done + k] += src[k];
+				done += count;
+				v.pos += count;
+				if (v.pos == clip.length)
+				{
+					v.pos = 0;
+					v.playing = clip.loop;
+				}
+			}
+		}
+		for (size_t k {0}; k < chunk; ++k)
+			out[k] = std::clamp<int32_t>(sum_[k], INT16_MIN, INT16_MAX);
+		out += chunk;
+		n -= chunk;
+	}
+}
+
+Audio_stream::Audio_stream(Mixer &mixer, Output out)
+	: mixer_ {mixer},
+	  out_ {std::move(out)}
+{
+}
+
+void Audio_stream::play(Sound s, uint64_t cycle)
+{
+	advance(cycle);
+	mixer_.play(s);
+}
+
+void Audio_stream::stop(Sound s, uint64_t cycle)
+{
+	advance(cycle);
+	mixer_.stop(s);
+}
+
+// Each sample goes to the first cycle at or after its time; counting from a
+// base keeps the products small and lets the clock go back.
+void Audio_stream::advance(uint64_t cycle)
+{
+	uint64_t target {base_sample_ + (cycle - base_cycle_) * mixer_.rate() / cpu_clock};
+	if (cycle < base_cycle_ || target < mixed_)
+	{
+		base_cycle_ = cycle;
+		base_sample_ = mixed_;
+		return;
+	}
+	while (mixed_ < target)
+	{
+		size_t n {static_cast<size_t>(std::min<uint64_t>(target - mixed_, buf_.size()))};
+		mixer_.mix(buf_.data(), n);
+		out_(buf_.data(), n);
+		mixed_ += n;
+	}
+}
+
+uint64_t Audio_stream::samples() const
+{
+	return mixed_;
+}
+
+Wav_writer::Wav_writer(const std::string &path, int rate)
+	: f_ {path, std::ios::binary},
+	  rate_ {rate}
+{
+	header();
+}
+
+Wav_writer::~Wav_writer()
+{
+	close();
+}
+
+bool Wav_writer::good() const
+{
+	return f_.good();
+}
+
+// little endian, whatever the host
+void Wav_writer::write(const int16_t *samples, size_t n)
+{
+	std::array<char, 4096> le;
+	while (n)
+	{
+		size_t count {std::min(n, le.size() / 2)};
+		for (size_t i {0}; i < count; ++i)
+		{
+			le[2 * i] = static_cast<char>(samples[i]);
+			le[2 * i + 1] = static_cast<char>(samples[i] >> 8);
+		}
+		f_.write(le.data(), 2 * count);
+		samples += count;
+		samples_ += count;
+		n -= count;
+	}
+}
+
+// true if everything made it to the file
+bool Wav_writer::close()
+{
+	if (!f_.is_open())
+		return false;
+	f_.seekp(0);
+	header();
+	bool ok {f_.good()};
+	f_.close();
+	return ok;
+}
+
+void Wav_writer::header()
+{
+	uint32_t data {static_cast<uint32_t>(samples_ * 2)};
+	const uint32_t fields[][2]
+	{
+		{0x46464952, 4}, {36 + data, 4}, {0x45564157, 4}, // "RIFF", size, "WAVE"
+		{0x20746D66, 4}, {16, 4}, {1, 2}, {1, 2}, // "fmt ", size, PCM, mono
+		{static_cast<uint32_t>(rate_), 4}, {static_cast<uint32_t>(rate_) * 2, 4}, {2, 2}, {16, 2},
+		{0x61746164, 4}, {data, 4} // "data", size
+	};
+	for (const auto &field : fields)
+		for (uint32_t i {0}; i < field[1]; ++i)
+			f_.put(static_cast<char>(field[0] >> (8 * i)));
+}
+
+}
@@ -0,0 +1,122 @@
+#include "movie.hpp"
+
+#include <fstream>
+
+namespace space_invaders
+{
+
+namespace
+{
+
+// movie layout, all little endian: magic, version, frame count, end hash,
+// then runs of frames with the same inputs as port 1, port 2 and length
+constexpr uint32_t movie_magic {0x564D4953}; // "SIMV"
+constexpr uint16_t movie_version {2}; // follows the save state's, which the end hash covers
+// a week of play; a longer movie is taken for a corrupt one rather than
+// allocated
+constexpr uint64_t max_frames {60ull * 60 * 60 * 24 * 7};
+
+void put(std::ostream &out, uint64_t x, int bytes)
+{
+	for (int i {0}; i < bytes; ++i)
+		out.put(static_cast<char>(x >> (8 * i)));
+}
+
+uint64_t get(std::istream &in, int bytes)
+{
+	uint64_t x {0};
+	for (int i {0}; i < bytes; ++i)
+		x |= static_cast<uint64_t>(static_cast<uint8_t>(in.get())) << (8 * i);
+	return x;
+}
+
+}
+
+void Movie::record(const Machine &m)
+{
+	inputs_.resize(m.frames());
+	inputs_.push_back(m.inputs());
+}
+
+void Movie::finish(const Machine &m)
+{
+	inputs_.resize(m.frames());
+	end_hash_ = hash_state(m);
+}
+
+bool Movie::play(Machine &m) const
+{
+	for (Inputs in : inputs_)
+	{
+		m.set_inputs(in);
+		m.step_frame();
+	}
+	return hash_state(m) == end_hash_;
+}
+
+uint64_t Movie::frames() const
+{
+	return inputs_.size();
+}
+
+uint64_t Movie::end_hash() const
+{
+	return end_hash_;
+}
+
+bool Movie::save(const std::string &path) const
+{
+	std::ofstream f {path, std::ios::binary};
+	put(f, movie_magic, 4);
+	put(f, movie_version, 2);
+	put(f, inputs_.size(), 8);
+	put(f, end_hash_, 8);
+	for (size_t i {0}; i < inputs_.size(); )
+	{
+		size_t run {i + 1};
+		while (run < inputs_.size() && inputs_[run] == inputs_[i] && run - i < UINT32_MAX)
+			++run;
+		put(f, inputs_[i].port1, 1);
+		put(f, inputs_[i].port2, 1);
+		put(f, run - i, 4);
+		i = run;
+	}
+	return f.good();
+}
+
+// leaves the movie untouched and returns false if the file is malformed or
+// from another version
+bool Movie::load(const std::string &path)
+{
+	std::ifstream f {path, std::ios::binary};
+	if (get(f, 4) != movie_magic || get(f, 2) != movie_version)
+		return false;
+	uint64_t frames {get(f, 8)};
+	uint64_t end_hash {get(f, 8)};
+	if (!f || frames > max_frames)
+		return false;
+	std::vector<Inputs> inputs;
+	while (inputs.size() < frames)
+	{
+		Inputs in;
+		in.port1 = get(f, 1);
+		in.port2 = get(f, 1);
+		uint64_t run {get(f, 4)};
+		if (!f || run == 0 || run > frames - inputs.size())
+			return false;
+		inputs.insert(inputs.end(), run, in);
+	}
+	inputs_ = std::move(inputs);
+	end_hash_ = end_hash;
+	return true;
+}
+
+uint64_t hash_state(const Machine &m)
+{
+	uint64_t h {0xCBF29CE484222325};
+	for (uint8_t b : m.save_state())
+		h = (h ^ b) * 0x100000001B3;
+	return h;
+}
+
+}
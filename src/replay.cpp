@@ -0,0 +1,75 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "machine.hpp"
+#include "mixer.hpp"
+#include "movie.hpp"
+
+// Plays a movie recorded with emulator --record back headless, as fast as
+// the host allows, and checks that it ends in the recorded state. With --wav
+// it also renders the session's sound into a WAV file on the way.
+int main(int argc, char *argv[])
+{
+	// usage: replay [--wav file] movie [rom]
+	std::string wav;
+	std::vector<std::string> args;
+	for (int i {1}; i < argc; ++i)
+	{
+		std::string arg {argv[i]};
+		if (arg == "--wav" && i + 1 < argc)
+			wav = argv[++i];
+		else
+			args.push_back(arg);
+	}
+	if (args.empty())
+	{
+		std::cerr << "usage: replay [--wav file] movie [rom]\n";
+		return 2;
+	}
+	std::string rom {args.size() > 1 ? args[1] : "invaders.rom"};
+	space_invaders::Movie movie {};
+	if (!movie.load(args[0]))
+	{
+		std::cerr << "Could not load movie " << args[0] << '\n';
+		return 2;
+	}
+	space_invaders::Machine cabinet {i8080::Dispatch::threaded};
+	if (!cabinet.load_program(rom))
+	{
+		std::cerr << "Could not open " << rom << '\n';
+		return 2;
+	}
+	space_invaders::Mixer mixer {};
+	std::unique_ptr<space_invaders::Wav_writer> writer;
+	std::unique_ptr<space_invaders::Audio_stream> stream;
+	if (!wav.empty())
+	{
+		if (!mixer.load_sounds())
+			std::cerr << "Could not load every sound from audio/\n";
+		writer = std::make_unique<space_invaders::Wav_writer>(wav, mixer.rate());
+		stream = std::make_unique<space_invaders::Audio_stream>(mixer,
+			[&writer](const int16_t *samples, size_t n) { writer->write(samples, n); });
+		cabinet.attach_audio(stream.get());
+	}
+	auto start = std::chrono::steady_clock::now();
+	bool same {movie.play(cabinet)};
+	if (stream)
+	{
+		stream->advance(cabinet.cpu().cycles());
+		if (!writer->close())
+		{
+			std::cerr << "Could not write " << wav << '\n';
+			return 2;
+		}
+	}
+	double secs {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+	std::cout << movie.frames() << " frames in " << std::fixed << std::setprecision(2) << secs
+		<< " s (" << std::setprecision(0) << movie.frames() / 60.0 / secs << "x real time)\n"
+		<< "end state " << std::hex << std::setfill('0') << std::setw(16) << space_invaders::hash_state(cabinet)
+		<< (same ? ", matches the recording\n" : ", differs from the recording\n");
+	return same ? 0 : 1;
+}
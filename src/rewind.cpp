@@ -0,0 +1,217 @@
+#include "rewind.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace space_invaders
+{
+
+namespace
+{
+
+uint8_t *put_length(uint8_t *out, size_t n)
+{
+	while (n >= 0x80)
+	{
+		*out++ = n | 0x80;
+		n >>= 7;
+	}
+	*out++ = n;
+	return out;
+}
+
+size_t get_length(const uint8_t *&in)
+{
+	size_t n {0};
+	for (int shift {0}; ; shift += 7)
+	{
+		uint8_t b {*in++};
+		n |= static_cast<size_t>(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			return n;
+	}
+}
+
+uint64_t load64(const uint8_t *p)
+{
+	uint64_t x;
+	std::memcpy(&x, p, 8);
+	return x;
+}
+
+// worst case: every word changed in every byte
+size_t max_encoded(size_t n)
+{
+	return (n + 7) / 8 * 9 + 16;
+}
+
+// Encodes a ^ b into out word by word and returns the size. A changed word
+// is a tag byte with a bit per changed byte, followed by those bytes
+// XORed; a run of unchanged words is a zero tag and the run length. The
+// changes between frames are mostly single sprite bytes scattered over
+// video ram, so the bytes of a word are packed without branching on them.
+size_t encode(const uint8_t *a, const uint8_t *b, size_t n, uint8_t *out)
+{
+	// the last word, zero-padded
+	uint8_t tail_a[8] {}, tail_b[8] {};
+	std::memcpy(tail_a, a + n / 8 * 8, n % 8);
+	std::memcpy(tail_b, b + n / 8 * 8, n % 8);
+	uint64_t tail {load64(tail_a) ^ load64(tail_b)};
+
+	uint8_t *o {out};
+	size_t words {(n + 7) / 8};
+	size_t same {0}; // unchanged words not yet written
+	for (size_t w {0}; w < words; ++w)
+	{
+		// skip unchanged stretches a cache line at a time
+		while (w + 8 <= n / 8 && std::memcmp(a + w * 8, b + w * 8, 64) == 0)
+		{
+			same += 8;
+			w += 8;
+		}
+		if (w == words)
+			break;
+		// little endian: byte i of x is byte w * 8 + i of the state
+		uint64_t x {w < n / 8 ? load64(a + w * 8) ^ load64(b + w * 8) : tail};
+		if (!x)
+		{
+			++same;
+			continue;
+		}
+		if (same)
+		{
+			*o++ = 0;
+			o = put_length(o, same - 1);
+			same = 0;
+		}
+		uint8_t *tag {o++};
+		unsigned bits {0};
+		for (int i {0}; i < 8; ++i)
+		{
+			uint8_t byte {static_cast<uint8_t>(x >> i * 8)};
+			*o = byte;
+			bits |= (byte != 0) << i;
+			o += byte != 0;
+		}
+		*tag = bits;
+	}
+	if (same)
+	{
+		*o++ = 0;
+		o = put_length(o, same - 1);
+	}
+	return o - out;
+}
+
+}
+
+Rewind::Rewind(size_t capacity, int interval)
+	: ring_(capacity),
+	  interval_ {interval}
+{
+}
+
+void Rewind::clear()
+{
+	entries_.clear();
+	head_ = 0;
+	newest_.clear();
+}
+
+size_t Rewind::entries() const
+{
+	return entries_.size();
+}
+
+size_t Rewind::bytes() const
+{
+	size_t n {0};
+	for (const Entry &e : entries_)
+		n += e.size;
+	return n;
+}
+
+void Rewind::record(const Machine &m)
+{
+	if (!entries_.empty() && m.frames() < entries_.back().frame + interval_)
+		return;
+	m.save_state(state_);
+	if (newest_.size() != state_.size())
+		newest_ = state_; // first entry: nothing to step back to from it
+	if (scratch_.size() < max_encoded(state_.size()))
+		scratch_.resize(max_encoded(state_.size()));
+	size_t size {encode(state_.data(), newest_.data(), state_.size(), scratch_.data())};
+	newest_.swap(state_);
+	push(m.frames(), size);
+}
+
+// copies the first size bytes of scratch_ into the ring, evicting whatever
+// they overwrite
+void Rewind::push(uint64_t frame, size_t size)
+{
+	if (size > ring_.size())
+	{
+		clear();
+		return;
+	}
+	if (head_ + size > ring_.size())
+	{
+		// whatever is still past the head is older than anything at the start
+		while (!entries_.empty() && entries_.front().offset >= head_)
+			entries_.pop_front();
+		head_ = 0;
+	}
+	while (!entries_.empty())
+	{
+		const Entry &oldest {entries_.front()};
+		bool overlaps {oldest.offset < head_ + size && head_ < oldest.offset + oldest.size};
+		if (!overlaps)
+			break;
+		entries_.pop_front();
+	}
+	std::copy_n(scratch_.begin(), size, ring_.begin() + head_);
+	entries_.push_back({frame, head_, size});
+	head_ += size;
+}
+
+// XORs entry e back out of newest_, leaving the state recorded before it
+void Rewind::undo(const Entry &e)
+{
+	const uint8_t *in {&ring_[e.offset]};
+	const uint8_t *end {in + e.size};
+	size_t i {0};
+	while (in < end)
+	{
+		uint8_t tag {*in++};
+		if (!tag)
+			i += (get_length(in) + 1) * 8;
+		else
+		{
+			for (int j {0}; j < 8; ++j)
+				if (tag & 1 << j)
+					newest_[i + j] ^= *in++;
+			i += 8;
+		}
+	}
+}
+
+// Restores the newest state from before the machine's current frame. The
+// restored entry stays in the ring, so recording carries on from it.
+bool Rewind::step_back(Machine &m)
+{
+	while (!entries_.empty() && entries_.back().frame >= m.frames())
+	{
+		undo(entries_.back());
+		entries_.pop_back();
+	}
+	if (entries_.empty())
+	{
+		clear();
+		return false;
+	}
+	const Entry &newest {entries_.back()};
+	head_ = newest.offset + newest.size;
+	return m.load_state(newest_);
+}
+
+}
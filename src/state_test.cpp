@@ -0,0 +1,111 @@
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "machine.hpp"
+
+// Saves, loads and forks a cabinet at points inside a frame, stepped in
+// pieces through next_event() and handle_events(), and checks that the
+// copies stay in step with the original. Each point is tried in attract mode
+// and during a game.
+
+namespace
+{
+
+using space_invaders::Machine;
+
+// runs the machine up to its next event, without handling it
+void run_to_event(Machine &m)
+{
+	m.cpu().run_until(m.next_event());
+}
+
+// the first frame either copy parts from the original, or -1
+long compare(Machine &m, Machine &loaded, Machine &forked, long frames)
+{
+	for (long f {0}; f < frames; ++f)
+	{
+		m.step_frame();
+		loaded.step_frame();
+		forked.step_frame();
+		std::vector<uint8_t> state {m.save_state()};
+		if (loaded.save_state() != state || forked.save_state() != state)
+			return f;
+	}
+	return -1;
+}
+
+struct Point
+{
+	const char *name;
+	std::function<void(Machine &)> reach; // from the start of a frame
+};
+
+const Point points[]
+{
+	{"start of frame", [](Machine &) {}},
+	{"at RST 1, not yet taken", run_to_event},
+	{"just after RST 1", [](Machine &m) { run_to_event(m); m.handle_events(); }},
+	{"after RST 1 and its EI", [](Machine &m)
+		{
+			run_to_event(m);
+			m.handle_events();
+			while (!m.cpu().state().int_enabled && m.cpu().cycles() < m.next_event())
+				m.cpu().emulate_op();
+		}},
+	{"at RST 2, not yet taken", [](Machine &m)
+		{
+			run_to_event(m);
+			m.handle_events();
+			run_to_event(m);
+		}}
+};
+
+}
+
+int main(int argc, char *argv[])
+{
+	std::string rom {argc > 1 ? argv[1] : "invaders.rom"};
+	if (!std::ifstream(rom).good())
+	{
+		std::cout << "no " << rom << ", skipping\n";
+		return 0;
+	}
+	int failures {0};
+	for (long at : {300L, 2000L})
+		for (const Point &p : points)
+		{
+			Machine m;
+			m.load_program(rom);
+			for (long f {0}; f < at; ++f)
+			{
+				// a coin and a game for one player, well before the second point
+				if (f == 1000)
+					m.press(space_invaders::Button::coin);
+				else if (f == 1010)
+				{
+					m.release(space_invaders::Button::coin);
+					m.press(space_invaders::Button::p1_start);
+				}
+				else if (f == 1020)
+					m.release(space_invaders::Button::p1_start);
+				m.step_frame();
+			}
+			p.reach(m);
+			Machine loaded;
+			loaded.load_program(rom);
+			std::unique_ptr<Machine> forked {m.fork()};
+			long frame {loaded.load_state(m.save_state()) ? compare(m, loaded, *forked, 600) : 0};
+			std::cout << "frame " << at << ", " << p.name << ": ";
+			if (frame >= 0)
+				std::cout << "a copy differs " << frame << " frames on\n";
+			else
+				std::cout << "copies match\n";
+			failures += frame >= 0;
+		}
+	return failures ? 1 : 0;
+}
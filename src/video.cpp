@@ -0,0 +1,374 @@
+#include "video.hpp"
+
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define SI_X86_SIMD
+	#include <immintrin.h>
+#endif
+
+namespace space_invaders
+{
+
+// The screen is converted in tiles of 8 columns by 8 rows: the 8 bytes at the
+// same offset in 8 neighbouring columns form an 8x8 bit matrix, and
+// transposing it turns each column byte into a row byte holding 8
+// horizontally adjacent pixels, which then expand into 8 contiguous
+// 32-bit pixels.
+
+namespace
+{
+
+constexpr uint32_t white {0xFFFFFF};
+constexpr int column_bytes {SCREEN_HEIGHT / 8};
+constexpr int groups {SCREEN_WIDTH / 8};
+
+// 8x8 bit matrix transpose, bit 8r + c <-> bit 8c + r
+uint64_t transpose8(uint64_t x)
+{
+	uint64_t t;
+	t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+	x = x ^ t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+	x = x ^ t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+	x = x ^ t ^ (t << 28);
+	return x;
+}
+
+// pixel row for bit j of the byte at offset k within a column
+uint32_t *row(uint32_t *pix, int k, int j)
+{
+	return pix + (SCREEN_HEIGHT - 1 - 8 * k - j) * SCREEN_WIDTH;
+}
+
+void expand_group_scalar(const uint8_t *vram, uint32_t *pix, int g)
+{
+	const uint8_t *src {vram + g * 8 * column_bytes};
+	pix += g * 8;
+	for (int k {0}; k < column_bytes; ++k)
+	{
+		uint64_t tile {0};
+		for (int c {0}; c < 8; ++c)
+			tile |= static_cast<uint64_t>(src[c * column_bytes + k]) << (8 * c);
+		tile = transpose8(tile);
+		for (int j {0}; j < 8; ++j)
+		{
+			uint32_t *dst {row(pix, k, j)};
+			uint8_t bits = tile >> (8 * j);
+			for (int c {0}; c < 8; ++c)
+				dst[c] = -static_cast<uint32_t>((bits >> c) & 1) & white;
+		}
+	}
+}
+
+#ifdef SI_X86_SIMD
+
+// gathers 16 tiles of a column group: the result holds, for each offset k
+// from k0 to k0 + 15, the 8 column bytes packed into one 64-bit lane. Always
+// inlined so the avx2 path gets VEX encoded copies and doesn't pay for
+// switching between legacy SSE and AVX code.
+__attribute__((target("sse2"), always_inline))
+inline void gather_sse2(const uint8_t *src, int k0, __m128i (&t)[8])
+{
+	__m128i a[8];
+	for (int c {0}; c < 8; ++c)
+		a[c] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + c * column_bytes + k0));
+	__m128i b[8];
+	for (int c {0}; c < 4; ++c)
+	{
+		b[2 * c] = _mm_unpacklo_epi8(a[2 * c], a[2 * c + 1]);
+		b[2 * c + 1] = _mm_unpackhi_epi8(a[2 * c], a[2 * c + 1]);
+	}
+	__m128i d[8];
+	for (int h {0}; h < 2; ++h)
+	{
+		d[4 * h] = _mm_unpacklo_epi16(b[h], b[2 + h]);
+		d[4 * h + 1] = _mm_unpackhi_epi16(b[h], b[2 + h]);
+		d[4 * h + 2] = _mm_unpacklo_epi16(b[4 + h], b[6 + h]);
+		d[4 * h + 3] = _mm_unpackhi_epi16(b[4 + h], b[6 + h]);
+	}
+	// d[4h + q] holds columns 0-3 (q < 2) or 4-7 (q >= 2) for offsets
+	// 8h + 4(q % 2) to 8h + 4(q % 2) + 3; pair them up into whole tiles
+	for (int h {0}; h < 2; ++h)
+	{
+		for (int q {0}; q < 2; ++q)
+		{
+			__m128i lo {d[4 * h + q]}, hi {d[4 * h + q + 2]};
+			t[4 * h + 2 * q] = _mm_unpacklo_epi32(lo, hi);
+			t[4 * h + 2 * q + 1] = _mm_unpackhi_epi32(lo, hi);
+		}
+	}
+}
+
+__attribute__((target("sse2")))
+__m128i transpose8_sse2(__m128i x)
+{
+	__m128i t;
+	t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 7)), _mm_set1_epi64x(0x00AA00AA00AA00AALL));
+	x = _mm_xor_si128(_mm_xor_si128(x, t), _mm_slli_epi64(t, 7));
+	t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 14)), _mm_set1_epi64x(0x0000CCCC0000CCCCLL));
+	x = _mm_xor_si128(_mm_xor_si128(x, t), _mm_slli_epi64(t, 14));
+	t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 28)), _mm_set1_epi64x(0x00000000F0F0F0F0LL));
+	x = _mm_xor_si128(_mm_xor_si128(x, t), _mm_slli_epi64(t, 28));
+	return x;
+}
+
+__attribute__((target("sse2")))
+void expand_group_sse2(const uint8_t *vram, uint32_t *pix, int g)
+{
+	const uint8_t *src {vram + g * 8 * column_bytes};
+	pix += g * 8;
+	const __m128i bits_lo {_mm_setr_epi32(1, 2, 4, 8)};
+	const __m128i bits_hi {_mm_setr_epi32(16, 32, 64, 128)};
+	const __m128i colour {_mm_set1_epi32(white)};
+	for (int k0 {0}; k0 < column_bytes; k0 += 16)
+	{
+		__m128i t[8];
+		gather_sse2(src, k0, t);
+		alignas(16) uint8_t rows[16];
+		for (int v {0}; v < 8; ++v)
+		{
+			_mm_store_si128(reinterpret_cast<__m128i *>(rows), transpose8_sse2(t[v]));
+			for (int n {0}; n < 16; ++n)
+			{
+				__m128i b {_mm_set1_epi32(rows[n])};
+				__m128i lo {_mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(b, bits_lo), bits_lo), colour)};
+				__m128i hi {_mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(b, bits_hi), bits_hi), colour)};
+				uint32_t *dst {row(pix, k0 + 2 * v + n / 8, n % 8)};
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), lo);
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4), hi);
+			}
+		}
+	}
+}
+
+__attribute__((target("avx2")))
+__m256i transpose8_avx2(__m256i x)
+{
+	__m256i t;
+	t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 7)), _mm256_set1_epi64x(0x00AA00AA00AA00AALL));
+	x = _mm256_xor_si256(_mm256_xor_si256(x, t), _mm256_slli_epi64(t, 7));
+	t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 14)), _mm256_set1_epi64x(0x0000CCCC0000CCCCLL));
+	x = _mm256_xor_si256(_mm256_xor_si256(x, t), _mm256_slli_epi64(t, 14));
+	t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 28)), _mm256_set1_epi64x(0x00000000F0F0F0F0LL));
+	x = _mm256_xor_si256(_mm256_xor_si256(x, t), _mm256_slli_epi64(t, 28));
+	return x;
+}
+
+__attribute__((target("avx2")))
+void expand_group_avx2(const uint8_t *vram, uint32_t *pix, int g)
+{
+	const uint8_t *src {vram + g * 8 * column_bytes};
+	pix += g * 8;
+	const __m256i bits {_mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128)};
+	const __m256i colour {_mm256_set1_epi32(white)};
+	for (int k0 {0}; k0 < column_bytes; k0 += 16)
+	{
+		__m128i t[8];
+		gather_sse2(src, k0, t);
+		alignas(32) uint8_t rows[32];
+		for (int v {0}; v < 8; v += 2)
+		{
+			__m256i pair {_mm256_set_m128i(t[v + 1], t[v])};
+			_mm256_store_si256(reinterpret_cast<__m256i *>(rows), transpose8_avx2(pair));
+			for (int n {0}; n < 32; ++n)
+			{
+				__m256i b {_mm256_set1_epi32(rows[n])};
+				__m256i px {_mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(b, bits), bits), colour)};
+				uint32_t *dst {row(pix, k0 + 2 * v + n / 8, n % 8)};
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), px);
+			}
+		}
+	}
+}
+
+#endif
+
+using Group_expander = void (*)(const uint8_t *, uint32_t *, int);
+
+Group_expander group_expander(Expander e)
+{
+	switch (e)
+	{
+		#ifdef SI_X86_SIMD
+		case Expander::sse2:
+			return expand_group_sse2;
+		case Expander::avx2:
+			return expand_group_avx2;
+		#endif
+		default:
+			return expand_group_scalar;
+	}
+}
+
+Expander detect()
+{
+	#ifdef SI_X86_SIMD
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return Expander::avx2;
+		if (__builtin_cpu_supports("sse2"))
+			return Expander::sse2;
+	#endif
+	return Expander::scalar;
+}
+
+}
+
+bool supported(Expander e)
+{
+	#ifdef SI_X86_SIMD
+		__builtin_cpu_init();
+	#endif
+	switch (e)
+	{
+		#ifdef SI_X86_SIMD
+		case Expander::sse2:
+			return __builtin_cpu_supports("sse2");
+		case Expander::avx2:
+			return __builtin_cpu_supports("avx2");
+		#endif
+		case Expander::scalar:
+			return true;
+		default:
+			return false;
+	}
+}
+
+Expander best_expander()
+{
+	static const Expander best {detect()};
+	return best;
+}
+
+void expand_frame(const uint8_t *vram, uint32_t *pix, Expander e)
+{
+	Group_expander expand {group_expander(e)};
+	for (int g {0}; g < groups; ++g)
+		expand(vram, pix, g);
+}
+
+void expand_frame(const uint8_t *vram, uint32_t *pix)
+{
+	expand_frame(vram, pix, best_expander());
+}
+
+void expand_columns(const uint8_t *vram, uint32_t *pix, const Column_mask &dirty, Expander e)
+{
+	Group_expander expand {group_expander(e)};
+	for (int g {0}; g < groups; ++g)
+	{
+		bool any {false};
+		for (int c {8 * g}; c < 8 * g + 8; ++c)
+			any |= dirty[c];
+		if (any)
+			expand(vram, pix, g);
+	}
+}
+
+void expand_columns(const uint8_t *vram, uint32_t *pix, const Column_mask &dirty)
+{
+	expand_columns(vram, pix, dirty, best_expander());
+}
+
+namespace
+{
+
+// each source row is widened once, then copied down for the rows it repeats
+// into; Scale is the factor, or 0 to take it from scale
+template <int Scale>
+void scale_rows(const uint32_t *pix, uint32_t *dst, int pitch, int scale)
+{
+	const int n {Scale ? Scale : scale};
+	for (int y {0}; y < SCREEN_HEIGHT; ++y, pix += SCREEN_WIDTH)
+	{
+		uint32_t *out {dst + y * n * pitch};
+		for (int x {0}; x < SCREEN_WIDTH; ++x)
+			for (int k {0}; k < n; ++k)
+				out[n * x + k] = pix[x];
+		for (int k {1}; k < n; ++k)
+			std::copy_n(out, n * SCREEN_WIDTH, out + k * pitch);
+	}
+}
+
+}
+
+void scale_frame(const uint32_t *pix, uint32_t *dst, int pitch, int scale)
+{
+	switch (scale)
+	{
+		case 1:
+			for (int y {0}; y < SCREEN_HEIGHT; ++y)
+				std::copy_n(pix + y * SCREEN_WIDTH, SCREEN_WIDTH, dst + y * pitch);
+			break;
+		case 2:
+			scale_rows<2>(pix, dst, pitch, 2);
+			break;
+		case 3:
+			scale_rows<3>(pix, dst, pitch, 3);
+			break;
+		case 4:
+			scale_rows<4>(pix, dst, pitch, 4);
+			break;
+		default:
+			scale_rows<0>(pix, dst, pitch, scale);
+	}
+}
+
+Y4m_writer::Y4m_writer(const std::string &path)
+	: buffer_(1 << 20),
+	  frame_(SCREEN_WIDTH * SCREEN_HEIGHT * 3 / 2)
+{
+	f_.rdbuf()->pubsetbuf(buffer_.data(), buffer_.size());
+	f_.open(path, std::ios::binary);
+	f_ << "YUV4MPEG2 W" << SCREEN_WIDTH << " H" << SCREEN_HEIGHT << " F60:1 Ip A1:1 C420jpeg\n";
+}
+
+bool Y4m_writer::good() const
+{
+	return f_.good();
+}
+
+// BT.601 in studio range, with each chroma sample taken from the average of
+// the 2x2 block of pixels it covers
+void Y4m_writer::write(const uint32_t *pix)
+{
+	uint8_t *y {frame_.data()};
+	uint8_t *cb {y + SCREEN_WIDTH * SCREEN_HEIGHT};
+	uint8_t *cr {cb + SCREEN_WIDTH * SCREEN_HEIGHT / 4};
+	for (int i {0}; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i)
+	{
+		int r {static_cast<int>(pix[i] >> 16 & 0xFF)}, g {static_cast<int>(pix[i] >> 8 & 0xFF)}, b {static_cast<int>(pix[i] & 0xFF)};
+		y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+	}
+	for (int row {0}; row < SCREEN_HEIGHT; row += 2)
+		for (int col {0}; col < SCREEN_WIDTH; col += 2)
+		{
+			int r {0}, g {0}, b {0};
+			for (int k : {0, 1, SCREEN_WIDTH, SCREEN_WIDTH + 1})
+			{
+				uint32_t p {pix[row * SCREEN_WIDTH + col + k]};
+				r += p >> 16 & 0xFF;
+				g += p >> 8 & 0xFF;
+				b += p & 0xFF;
+			}
+			int c {row / 2 * SCREEN_WIDTH / 2 + col / 2};
+			cb[c] = ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128;
+			cr[c] = ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128;
+		}
+	f_ << "FRAME\n";
+	f_.write(reinterpret_cast<const char *>(frame_.data()), frame_.size());
+}
+
+bool Y4m_writer::close()
+{
+	if (!f_.is_open())
+		return false;
+	f_.flush();
+	bool ok {f_.good()};
+	f_.close();
+	return ok;
+}
+
+}